@@ -22,26 +22,114 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "libanyvnc/core/Server.h"
+#include "libanyvnc/core/SessionHost.h"
 
 ANYVNC_DECL_EXPORT int main( int argc, char **argv )
 {
 	int port = 5900;
 	std::string password{};
+	bool printStatistics = false;
+	int sessionCount = 1;
+	std::string framebufferPlugin{};
+	int scaledMirrorPort = 0;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[i], "--statistics" ) == 0 )
+		{
+			printStatistics = true;
+		}
+		else if( strcmp( argv[i], "--sessions" ) == 0 && i+1 < argc )
+		{
+			sessionCount = std::max( atoi( argv[++i] ), 1 );
+		}
+		else if( strcmp( argv[i], "--framebuffer" ) == 0 && i+1 < argc )
+		{
+			framebufferPlugin = argv[++i];
+		}
+		else if( strcmp( argv[i], "--scaled-mirrors" ) == 0 && i+1 < argc )
+		{
+			scaledMirrorPort = std::max( atoi( argv[++i] ), 0 );
+		}
+		else
+		{
+			password = argv[i];
+		}
+	}
 
-	if( argc > 1 )
+	// additional sessions are served on consecutive ports
+	std::vector<std::unique_ptr<AnyVnc::Core::Server>> servers;
+	for( int i = 0; i < sessionCount; ++i )
 	{
-		password = argv[1];
+		auto server = std::make_unique<AnyVnc::Core::Server>();
+		server->setPort( port + i );
+		server->setPassword( password );
+		server->setFramebufferPlugin( framebufferPlugin );
+		if( scaledMirrorPort > 0 )
+		{
+			server->setScaledMirrorPort( scaledMirrorPort + i * int(AnyVnc::Core::Server::ScaledMirrorScales.size()) );
+		}
+		servers.push_back( std::move(server) );
 	}
 
-	AnyVnc::Core::Server server;
-	server.setPort( port );
-	server.setPassword( password );
+	std::atomic<bool> running{true};
+	std::thread statisticsThread;
+
+	if( printStatistics )
+	{
+		statisticsThread = std::thread( [&servers, &running]() {
+			static constexpr auto StatisticsInterval = std::chrono::seconds(5);
+			static constexpr auto PollInterval = std::chrono::milliseconds(100);
+
+			auto nextReport = std::chrono::steady_clock::now() + StatisticsInterval;
+			while( running )
+			{
+				std::this_thread::sleep_for( PollInterval );
+				if( std::chrono::steady_clock::now() >= nextReport )
+				{
+					for( const auto& server : servers )
+					{
+						std::cerr << "port " << server->port() << "\n" << server->instrumentation().report() << std::endl;
+					}
+					nextReport += StatisticsInterval;
+				}
+			}
+		} );
+	}
+
+	bool result = false;
+
+	if( servers.size() > 1 )
+	{
+		AnyVnc::Core::SessionHost sessionHost;
+		for( const auto& server : servers )
+		{
+			sessionHost.addSession( server.get() );
+		}
+
+		result = sessionHost.run();
+	}
+	else
+	{
+		result = servers.front()->run();
+	}
 
-	if( server.run() )
+	running = false;
+	if( statisticsThread.joinable() )
 	{
-		return 0;
+		statisticsThread.join();
 	}
 
-	return -1;
+	return result ? 0 : -1;
 }
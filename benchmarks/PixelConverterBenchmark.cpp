@@ -0,0 +1,146 @@
+/*
+ * PixelConverterBenchmark.cpp - throughput of the PixelConverter kernels
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "libanyvnc/core/PixelConverter.h"
+
+using AnyVnc::Core::PixelConverter;
+using AnyVnc::Types::Region;
+using AnyVnc::Types::Size;
+
+static constexpr auto FrameWidth = 1920;
+static constexpr auto FrameHeight = 1080;
+
+
+static int bytesPerPixel( PixelConverter::SourceFormat format )
+{
+	switch( format )
+	{
+	case PixelConverter::SourceFormat::RGBA8888:
+	case PixelConverter::SourceFormat::RGBX8888: return 4;
+	case PixelConverter::SourceFormat::RGB888: return 3;
+	case PixelConverter::SourceFormat::RGB565: return 2;
+	}
+
+	return 4;
+}
+
+
+
+static const char* name( PixelConverter::SourceFormat format )
+{
+	switch( format )
+	{
+	case PixelConverter::SourceFormat::RGBA8888: return "RGBA8888";
+	case PixelConverter::SourceFormat::RGBX8888: return "RGBX8888";
+	case PixelConverter::SourceFormat::RGB888: return "RGB888";
+	case PixelConverter::SourceFormat::RGB565: return "RGB565";
+	}
+
+	return "unknown";
+}
+
+
+
+// converts full frames which either all differ from the previous one or are
+// identical to it - throughput is reported per source byte
+static void convertFrames( benchmark::State& state, PixelConverter::InstructionSet instructionSet,
+						   PixelConverter::SourceFormat format, bool changing )
+{
+	const auto sourceBytesPerLine = FrameWidth * bytesPerPixel( format );
+	const auto frameBytes = size_t(sourceBytesPerLine) * FrameHeight;
+
+	std::mt19937 random;
+	std::vector<uint8_t> frames[2];
+	for( auto& frame : frames )
+	{
+		frame.resize( frameBytes );
+		for( auto& byte : frame )
+		{
+			byte = uint8_t( random() );
+		}
+	}
+
+	std::vector<uint32_t> destination( size_t(FrameWidth) * FrameHeight );
+
+	PixelConverter converter;
+	converter.setInstructionSet( instructionSet );
+
+	Region damage;
+	size_t frame = 0;
+
+	for( auto _ : state )
+	{
+		if( changing )
+		{
+			frame ^= 1;
+		}
+
+		damage.clear();
+		converter.convert( format, frames[frame].data(), sourceBytesPerLine,
+						   destination.data(), FrameWidth * int(sizeof(uint32_t)),
+						   Size{ FrameWidth, FrameHeight }, &damage );
+		benchmark::DoNotOptimize( damage.isEmpty() );
+	}
+
+	state.SetBytesProcessed( int64_t( state.iterations() ) * int64_t( frameBytes ) );
+}
+
+
+
+int main( int argc, char** argv )
+{
+	using InstructionSet = PixelConverter::InstructionSet;
+	using SourceFormat = PixelConverter::SourceFormat;
+
+	for( auto instructionSet : { InstructionSet::Generic, InstructionSet::SSE2, InstructionSet::AVX2, InstructionSet::NEON } )
+	{
+		if( PixelConverter::isSupported( instructionSet ) == false )
+		{
+			continue;
+		}
+
+		for( auto format : { SourceFormat::RGBA8888, SourceFormat::RGBX8888, SourceFormat::RGB888, SourceFormat::RGB565 } )
+		{
+			for( auto changing : { true, false } )
+			{
+				const auto benchmarkName = std::string( PixelConverter::name( instructionSet ) ) + "/" +
+										   name( format ) + ( changing ? "/changed" : "/unchanged" );
+				benchmark::RegisterBenchmark( benchmarkName.c_str(), convertFrames, instructionSet, format, changing );
+			}
+		}
+	}
+
+	benchmark::Initialize( &argc, argv );
+	benchmark::RunSpecifiedBenchmarks();
+
+	return 0;
+}
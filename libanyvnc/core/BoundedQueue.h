@@ -0,0 +1,160 @@
+/*
+ * core/BoundedQueue.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// thread-safe FIFO with a fixed capacity - producers block while the queue
+// is full which propagates backpressure to earlier pipeline stages
+template<class T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue( size_t capacity ) :
+		m_capacity( capacity )
+	{
+	}
+
+	bool push( T&& item )
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+
+		if( m_items.size() >= m_capacity && m_closed == false )
+		{
+			++m_stalls;
+			m_notFull.wait( lock, [this]() { return m_items.size() < m_capacity || m_closed; } );
+		}
+
+		if( m_closed )
+		{
+			return false;
+		}
+
+		m_items.push_back( std::move(item) );
+		m_maxDepth = std::max( m_maxDepth, m_items.size() );
+		++m_pushed;
+
+		return true;
+	}
+
+	bool tryPop( T& item )
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+
+		if( m_items.empty() )
+		{
+			return false;
+		}
+
+		item = std::move( m_items.front() );
+		m_items.pop_front();
+
+		lock.unlock();
+		m_notFull.notify_one();
+
+		return true;
+	}
+
+	void open()
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_items.clear();
+		m_closed = false;
+	}
+
+	void clear()
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_items.clear();
+		lock.unlock();
+
+		m_notFull.notify_all();
+	}
+
+	void close()
+	{
+		std::unique_lock<std::mutex> lock( m_mutex );
+		m_closed = true;
+		lock.unlock();
+
+		m_notFull.notify_all();
+	}
+
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	size_t depth() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_items.size();
+	}
+
+	size_t maxDepth() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_maxDepth;
+	}
+
+	uint64_t pushed() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_pushed;
+	}
+
+	uint64_t stalls() const
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		return m_stalls;
+	}
+
+private:
+	const size_t m_capacity;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::deque<T> m_items;
+	bool m_closed{false};
+
+	size_t m_maxDepth{0};
+	uint64_t m_pushed{0};
+	uint64_t m_stalls{0};
+
+};
+
+}
+
+}
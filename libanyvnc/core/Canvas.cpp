@@ -0,0 +1,312 @@
+/*
+ * Canvas.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Canvas.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+Canvas::Canvas( Types::Size size ) :
+	m_size( std::max( size.width(), 1 ), std::max( size.height(), 1 ) ),
+	m_pixels( size_t(m_size.width()) * size_t(m_size.height()) ),
+	m_frontBufferSize( m_size ),
+	m_frontBuffer( m_pixels ),
+	m_frontBufferData( m_frontBuffer.data() )
+{
+}
+
+
+
+Canvas::~Canvas() = default;
+
+
+
+bool Canvas::initialize( Server* )
+{
+	return true;
+}
+
+
+
+void* Canvas::data() const
+{
+	return m_frontBufferData;
+}
+
+
+
+Types::Size Canvas::size() const
+{
+	return m_frontBufferSize;
+}
+
+
+
+Canvas::UpdateFlags Canvas::update( Types::Region* damage, Types::Moves* moves )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	m_damageEvent.reset();
+	m_damageSignaled = false;
+
+	UpdateFlags updateFlags{};
+
+	if( m_sizeChanged )
+	{
+		m_frontBufferSize = m_size;
+		m_frontBuffer = m_pixels;
+		m_frontBufferData = m_frontBuffer.data();
+
+		damage->add( bounds() );
+		updateFlags |= UpdateFlag::SizeChanged;
+	}
+	else
+	{
+		for( const auto& move : m_pendingMoves )
+		{
+			copyToFrontBuffer( move.destination() );
+			Types::appendMove( move, damage, moves );
+		}
+
+		for( const auto& rect : m_pendingDamage.rectangles() )
+		{
+			copyToFrontBuffer( rect );
+		}
+
+		damage->add( m_pendingDamage );
+	}
+
+	m_pendingDamage.clear();
+	m_pendingMoves.clear();
+	m_sizeChanged = false;
+
+	return updateFlags;
+}
+
+
+
+Types::Screens Canvas::availableScreens() const
+{
+	return { Types::Screen{ m_frontBufferSize, pixelFormat().depth() } };
+}
+
+
+
+void Canvas::resize( Types::Size size )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	m_size = { std::max( size.width(), 1 ), std::max( size.height(), 1 ) };
+	m_pixels.assign( size_t(m_size.width()) * size_t(m_size.height()), 0 );
+	m_sizeChanged = true;
+
+	signalDamage();
+}
+
+
+
+void Canvas::fill( const Types::Rectangle& rect, uint32_t color )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const auto area = rect.intersected( bounds() );
+	if( area.isEmpty() )
+	{
+		return;
+	}
+
+	for( int y = area.top(); y <= area.bottom(); ++y )
+	{
+		std::fill_n( scanLine( y ) + area.left(), area.width(), color );
+	}
+
+	addDamage( area );
+}
+
+
+
+void Canvas::blit( Types::Point position, const void* data, Types::Size size, int bytesPerLine )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const Types::Rectangle rect( position.x(), position.y(),
+								 position.x() + size.width() - 1, position.y() + size.height() - 1 );
+	const auto area = rect.intersected( bounds() );
+	if( area.isEmpty() )
+	{
+		return;
+	}
+
+	const auto source = static_cast<const uint8_t *>( data ) +
+						size_t(area.top() - rect.top()) * size_t(bytesPerLine) +
+						size_t(area.left() - rect.left()) * sizeof(uint32_t);
+
+	for( int y = 0; y < area.height(); ++y )
+	{
+		memcpy( scanLine( area.top() + y ) + area.left(), source + size_t(y) * size_t(bytesPerLine),
+				size_t(area.width()) * sizeof(uint32_t) );
+	}
+
+	addDamage( area );
+}
+
+
+
+void Canvas::copyArea( const Types::Rectangle& source, Types::Point destination )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const auto dx = destination.x() - source.left();
+	const auto dy = destination.y() - source.top();
+
+	// both the source and the destination have to lie within the canvas
+	const auto sourceArea = source.intersected( bounds() ).intersected( bounds().translated( -dx, -dy ) );
+	if( sourceArea.isEmpty() || ( dx == 0 && dy == 0 ) )
+	{
+		return;
+	}
+
+	const Types::Move move( sourceArea.translated( dx, dy ), dx, dy );
+	const auto& destinationArea = move.destination();
+	const auto length = size_t(destinationArea.width()) * sizeof(uint32_t);
+
+	// copy in the direction which doesn't overwrite lines not copied yet
+	const auto copyLine = [&]( int row ) {
+		memmove( scanLine( destinationArea.top() + row ) + destinationArea.left(),
+				 scanLine( sourceArea.top() + row ) + sourceArea.left(), length );
+	};
+
+	if( dy > 0 )
+	{
+		for( int row = destinationArea.height() - 1; row >= 0; --row )
+		{
+			copyLine( row );
+		}
+	}
+	else
+	{
+		for( int row = 0; row < destinationArea.height(); ++row )
+		{
+			copyLine( row );
+		}
+	}
+
+	if( m_pendingMoves.size() < MaxPendingMoves )
+	{
+		Types::appendMove( move, &m_pendingDamage, &m_pendingMoves );
+		signalDamage();
+	}
+	else
+	{
+		addDamage( destinationArea );
+	}
+}
+
+
+
+void Canvas::drawGlyph( Types::Point position, const uint8_t* coverage, Types::Size size, int bytesPerLine,
+						uint32_t color )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const Types::Rectangle rect( position.x(), position.y(),
+								 position.x() + size.width() - 1, position.y() + size.height() - 1 );
+	const auto area = rect.intersected( bounds() );
+	if( area.isEmpty() )
+	{
+		return;
+	}
+
+	const auto blend = []( uint32_t background, uint32_t foreground, uint32_t alpha ) {
+		uint32_t result = 0;
+		for( int shift = 0; shift <= 16; shift += 8 )
+		{
+			const auto b = ( background >> shift ) & 0xff;
+			const auto f = ( foreground >> shift ) & 0xff;
+			result |= ( ( f * alpha + b * ( 255 - alpha ) + 127 ) / 255 ) << shift;
+		}
+		return result;
+	};
+
+	for( int y = area.top(); y <= area.bottom(); ++y )
+	{
+		const auto mask = coverage + size_t(y - rect.top()) * size_t(bytesPerLine) + ( area.left() - rect.left() );
+		auto line = scanLine( y ) + area.left();
+
+		for( int x = 0; x < area.width(); ++x )
+		{
+			if( mask[x] == 0xff )
+			{
+				line[x] = color;
+			}
+			else if( mask[x] )
+			{
+				line[x] = blend( line[x], color, mask[x] );
+			}
+		}
+	}
+
+	addDamage( area );
+}
+
+
+
+void Canvas::addDamage( const Types::Rectangle& rect )
+{
+	m_pendingDamage.add( rect );
+	signalDamage();
+}
+
+
+
+void Canvas::signalDamage()
+{
+	// once per update() to keep drawing cheap
+	if( m_damageSignaled == false )
+	{
+		m_damageEvent.signal();
+		m_damageSignaled = true;
+	}
+}
+
+
+
+void Canvas::copyToFrontBuffer( const Types::Rectangle& rect )
+{
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		const auto offset = size_t(y) * size_t(m_size.width()) + size_t(rect.left());
+		memcpy( m_frontBuffer.data() + offset, m_pixels.data() + offset, size_t(rect.width()) * sizeof(uint32_t) );
+	}
+}
+
+}
+
+}
@@ -0,0 +1,148 @@
+/*
+ * Canvas.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/core/Event.h"
+#include "libanyvnc/interfaces/Framebuffer.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+// framebuffer which applications draw into directly - passed to
+// Server::setFramebuffer(), all drawing operations record their damage (and
+// copyArea() a move) so nothing has to be captured or compared. Drawing is
+// thread-safe, colors are 0xRRGGBB values.
+class ANYVNC_CORE_EXPORT Canvas : public Interfaces::Framebuffer
+{
+public:
+	explicit Canvas( Types::Size size );
+	~Canvas() override;
+
+	std::string uid() const override
+	{
+		return "0b6d3f8a-92e1-4c57-a4f0-d18e6b2c7a59";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "Canvas";
+	}
+
+	std::string description() const override
+	{
+		return "Framebuffer drawn into by the application";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	bool initialize( Server* server ) override;
+
+	void* data() const override;
+	Types::Size size() const override;
+
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
+
+	Types::Screens availableScreens() const override;
+
+	Types::EventHandle damageEvent() const override
+	{
+		return m_damageEvent.handle();
+	}
+
+	// clears the canvas
+	void resize( Types::Size size );
+
+	void fill( const Types::Rectangle& rect, uint32_t color );
+
+	// draws an image in xrgb8888 format
+	void blit( Types::Point position, const void* data, Types::Size size, int bytesPerLine );
+
+	// moves the contents of source to destination - sent to clients as CopyRect
+	void copyArea( const Types::Rectangle& source, Types::Point destination );
+
+	// blends color into the canvas using an 8 bit coverage mask as produced by
+	// font rasterizers
+	void drawGlyph( Types::Point position, const uint8_t* coverage, Types::Size size, int bytesPerLine,
+					uint32_t color );
+
+private:
+	static constexpr auto MaxPendingMoves = 64;
+
+	Types::Rectangle bounds() const
+	{
+		return { 0, 0, m_size.width() - 1, m_size.height() - 1 };
+	}
+
+	uint32_t* scanLine( int y )
+	{
+		return m_pixels.data() + size_t(y) * size_t(m_size.width());
+	}
+
+	void addDamage( const Types::Rectangle& rect );
+	void signalDamage();
+	void copyToFrontBuffer( const Types::Rectangle& rect );
+
+	mutable std::mutex m_mutex;
+	Types::Size m_size;
+	std::vector<uint32_t> m_pixels;
+	Types::Region m_pendingDamage;
+	Types::Moves m_pendingMoves;
+	bool m_sizeChanged{false};
+	Event m_damageEvent;
+	bool m_damageSignaled{false};
+
+	// what the server sees - only changed in update() so that data() stays
+	// valid while snapshots are taken from it
+	Types::Size m_frontBufferSize;
+	std::vector<uint32_t> m_frontBuffer;
+	void* m_frontBufferData{nullptr};
+
+};
+
+}
+
+}
@@ -0,0 +1,230 @@
+/*
+ * core/Event.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Event.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+Event::Event()
+{
+#if defined(WIN32)
+	m_readHandle = CreateEvent( nullptr, TRUE, FALSE, nullptr );
+	m_writeHandle = m_readHandle;
+#elif defined(__linux__)
+	m_readHandle = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	m_writeHandle = m_readHandle;
+#else
+	int fds[2];
+	if( pipe( fds ) == 0 )
+	{
+		for( auto fd : fds )
+		{
+			fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+			fcntl( fd, F_SETFD, FD_CLOEXEC );
+		}
+		m_readHandle = fds[0];
+		m_writeHandle = fds[1];
+	}
+#endif
+}
+
+
+
+Event::~Event()
+{
+#if defined(WIN32)
+	if( m_readHandle != Types::InvalidEventHandle )
+	{
+		CloseHandle( m_readHandle );
+	}
+#else
+	if( m_writeHandle != m_readHandle && m_writeHandle != Types::InvalidEventHandle )
+	{
+		close( m_writeHandle );
+	}
+
+	if( m_readHandle != Types::InvalidEventHandle )
+	{
+		close( m_readHandle );
+	}
+#endif
+}
+
+
+
+void Event::signal()
+{
+#if defined(WIN32)
+	SetEvent( m_writeHandle );
+#else
+#if defined(__linux__)
+	const uint64_t value = 1;
+#else
+	const char value = 1;
+#endif
+	// a failing write means the event is signaled already
+	if( write( m_writeHandle, &value, sizeof(value) ) < 0 )
+	{
+		return;
+	}
+#endif
+}
+
+
+
+bool Event::reset()
+{
+#if defined(WIN32)
+	const auto signaled = WaitForSingleObject( m_readHandle, 0 ) == WAIT_OBJECT_0;
+	ResetEvent( m_readHandle );
+	return signaled;
+#elif defined(__linux__)
+	uint64_t value = 0;
+	return read( m_readHandle, &value, sizeof(value) ) > 0;
+#else
+	char buffer[64];
+	bool signaled = false;
+	while( read( m_readHandle, buffer, sizeof(buffer) ) > 0 )
+	{
+		signaled = true;
+	}
+	return signaled;
+#endif
+}
+
+
+
+bool Event::wait( Types::EventHandle handle, int timeout )
+{
+#if defined(WIN32)
+	return WaitForSingleObject( handle, timeout < 0 ? INFINITE : DWORD(timeout) ) == WAIT_OBJECT_0;
+#else
+	pollfd pfd{ handle, POLLIN, 0 };
+	return poll( &pfd, 1, timeout ) > 0 && ( pfd.revents & POLLIN );
+#endif
+}
+
+
+
+int Event::waitForAny( const std::vector<Types::EventHandle>& handles, int timeout )
+{
+#if defined(WIN32)
+	const auto result = WaitForMultipleObjects( DWORD(handles.size()), handles.data(), FALSE,
+												timeout < 0 ? INFINITE : DWORD(timeout) );
+	if( result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size() )
+	{
+		return int(result - WAIT_OBJECT_0);
+	}
+#else
+	std::vector<pollfd> pfds;
+	pfds.reserve( handles.size() );
+	for( auto handle : handles )
+	{
+		pfds.push_back( { handle, POLLIN, 0 } );
+	}
+
+	if( poll( pfds.data(), pfds.size(), timeout ) > 0 )
+	{
+		for( size_t i = 0; i < pfds.size(); ++i )
+		{
+			if( pfds[i].revents & POLLIN )
+			{
+				return int(i);
+			}
+		}
+	}
+#endif
+
+	return -1;
+}
+
+
+
+bool Event::waitForMultiple( const std::vector<Types::EventHandle>& handles, int timeout,
+							 std::vector<bool>* signaled )
+{
+	signaled->assign( handles.size(), false );
+
+	bool anySignaled = false;
+
+#if defined(WIN32)
+	// handles beyond MAXIMUM_WAIT_OBJECTS are only checked after waiting for the others
+	const auto count = std::min<size_t>( handles.size(), MAXIMUM_WAIT_OBJECTS );
+	WaitForMultipleObjects( DWORD(count), handles.data(), FALSE, timeout < 0 ? INFINITE : DWORD(timeout) );
+
+	for( size_t i = 0; i < handles.size(); ++i )
+	{
+		if( WaitForSingleObject( handles[i], 0 ) == WAIT_OBJECT_0 )
+		{
+			(*signaled)[i] = true;
+			anySignaled = true;
+		}
+	}
+#else
+	std::vector<pollfd> pfds;
+	pfds.reserve( handles.size() );
+	for( auto handle : handles )
+	{
+		pfds.push_back( { handle, POLLIN, 0 } );
+	}
+
+	if( poll( pfds.data(), pfds.size(), timeout ) > 0 )
+	{
+		for( size_t i = 0; i < pfds.size(); ++i )
+		{
+			if( pfds[i].revents & ( POLLIN | POLLHUP | POLLERR ) )
+			{
+				(*signaled)[i] = true;
+				anySignaled = true;
+			}
+		}
+	}
+#endif
+
+	return anySignaled;
+}
+
+}
+
+}
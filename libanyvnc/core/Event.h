@@ -0,0 +1,79 @@
+/*
+ * core/Event.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/EventHandle.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// waitable and selectable event object (eventfd on Linux, pipe on other
+// POSIX systems, event object on Windows)
+class ANYVNC_CORE_EXPORT Event
+{
+public:
+	Event();
+	~Event();
+
+	Event( const Event& ) = delete;
+	Event& operator=( const Event& ) = delete;
+
+	Types::EventHandle handle() const
+	{
+		return m_readHandle;
+	}
+
+	void signal();
+	bool reset();
+
+	bool wait( int timeout )
+	{
+		return wait( m_readHandle, timeout );
+	}
+
+	static bool wait( Types::EventHandle handle, int timeout );
+
+	// returns index of first signaled handle or -1 on timeout
+	static int waitForAny( const std::vector<Types::EventHandle>& handles, int timeout );
+
+	// flags all signaled handles, returns false on timeout
+	static bool waitForMultiple( const std::vector<Types::EventHandle>& handles, int timeout,
+								 std::vector<bool>* signaled );
+
+private:
+	Types::EventHandle m_readHandle{Types::InvalidEventHandle};
+	Types::EventHandle m_writeHandle{Types::InvalidEventHandle};
+
+};
+
+}
+
+}
@@ -0,0 +1,122 @@
+/*
+ * core/FrameRateGovernor.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+
+#include "FrameRateGovernor.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+void FrameRateGovernor::setMaximumFrameRate( int maximumFrameRate )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_maximumFrameRate = std::clamp( maximumFrameRate, 1, MaximumFrameRate );
+}
+
+
+
+void FrameRateGovernor::setCpuBudget( int cpuBudget )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_cpuBudget = std::clamp( cpuBudget, 1, 100 );
+}
+
+
+
+void FrameRateGovernor::reset()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_captureCost = 0;
+	m_damagedPixelsPerFrame = 0;
+	m_encodeCostPerPixel = 0;
+	m_roundTrip = 0;
+}
+
+
+
+void FrameRateGovernor::reportCapture( Duration cost, uint64_t damagedPixels )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	smooth( &m_captureCost, double(cost.count()) );
+	smooth( &m_damagedPixelsPerFrame, double(damagedPixels) );
+}
+
+
+
+void FrameRateGovernor::reportEncode( Duration cost, uint64_t encodedPixels )
+{
+	if( encodedPixels > 0 )
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		smooth( &m_encodeCostPerPixel, double(cost.count()) / double(encodedPixels) );
+	}
+}
+
+
+
+void FrameRateGovernor::reportRoundTrip( Duration roundTrip )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	smooth( &m_roundTrip, double(roundTrip.count()) );
+}
+
+
+
+FrameRateGovernor::Duration FrameRateGovernor::frameInterval() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	const auto minimumInterval = double( Duration( std::chrono::seconds(1) ).count() ) / m_maximumFrameRate;
+
+	// expected work for the next frame given the current amount of damage
+	const auto frameCost = m_captureCost + m_encodeCostPerPixel * m_damagedPixelsPerFrame;
+
+	// stretch interval so that frameCost only takes cpuBudget percent of it -
+	// under heavy churn this drops to a sustainable rate, while sporadic small
+	// changes still run at the maximum frame rate
+	const auto budgetInterval = frameCost * 100 / m_cpuBudget;
+
+	// capturing much faster than clients request updates only wastes resources,
+	// but allow one frame to be prepared while the previous one is in flight
+	const auto interval = std::max( { minimumInterval, budgetInterval, m_roundTrip / 2 } );
+
+	return std::min( Duration( int64_t(interval) ), Duration( MaximumFrameInterval ) );
+}
+
+
+
+FrameRateGovernor::Duration FrameRateGovernor::minimumFrameInterval() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	return Duration( std::chrono::seconds(1) ) / m_maximumFrameRate;
+}
+
+}
+
+}
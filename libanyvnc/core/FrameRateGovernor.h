@@ -0,0 +1,107 @@
+/*
+ * core/FrameRateGovernor.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "libanyvnc/core/AnyVncCore.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// determines the interval between two captures from the measured costs of
+// capturing and encoding, the amount of damage per frame and the time
+// clients need to request the next update
+class ANYVNC_CORE_EXPORT FrameRateGovernor
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using Duration = std::chrono::microseconds;
+
+	static constexpr auto DefaultMaximumFrameRate = 60;
+	static constexpr auto DefaultCpuBudget = 50;
+
+	FrameRateGovernor() = default;
+
+	int maximumFrameRate() const
+	{
+		return m_maximumFrameRate;
+	}
+
+	void setMaximumFrameRate( int maximumFrameRate );
+
+	// percentage of one CPU core to spend on capturing and encoding
+	int cpuBudget() const
+	{
+		return m_cpuBudget;
+	}
+
+	void setCpuBudget( int cpuBudget );
+
+	void reset();
+
+	void reportCapture( Duration cost, uint64_t damagedPixels );
+	void reportEncode( Duration cost, uint64_t encodedPixels );
+	void reportRoundTrip( Duration roundTrip );
+
+	Duration frameInterval() const;
+
+	// interval at the maximum frame rate, regardless of the measured costs
+	Duration minimumFrameInterval() const;
+
+	int frameRate() const
+	{
+		return int( std::chrono::seconds(1) / frameInterval() );
+	}
+
+private:
+	static constexpr auto MaximumFrameRate = 1000;
+	static constexpr auto MaximumFrameInterval = std::chrono::milliseconds(1000);
+	static constexpr auto SmoothingFactor = 0.125;
+
+	static void smooth( double* average, double value )
+	{
+		*average += ( value - *average ) * SmoothingFactor;
+	}
+
+	mutable std::mutex m_mutex;
+
+	int m_maximumFrameRate{DefaultMaximumFrameRate};
+	int m_cpuBudget{DefaultCpuBudget};
+
+	double m_captureCost{0};
+	double m_damagedPixelsPerFrame{0};
+	double m_encodeCostPerPixel{0};
+	double m_roundTrip{0};
+
+};
+
+}
+
+}
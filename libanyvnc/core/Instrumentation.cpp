@@ -0,0 +1,286 @@
+/*
+ * core/Instrumentation.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <ostream>
+
+#include "Instrumentation.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+void Instrumentation::Histogram::record( Duration duration )
+{
+	const auto value = uint64_t( std::max<Duration::rep>( duration.count(), 0 ) );
+
+	m_buckets[bucketIndex(value)].fetch_add( 1, std::memory_order_relaxed );
+	m_sum.fetch_add( value, std::memory_order_relaxed );
+
+	auto max = m_max.load( std::memory_order_relaxed );
+	while( value > max &&
+		   m_max.compare_exchange_weak( max, value, std::memory_order_relaxed ) == false )
+	{
+	}
+}
+
+
+
+void Instrumentation::Histogram::reset()
+{
+	for( auto& bucket : m_buckets )
+	{
+		bucket.store( 0, std::memory_order_relaxed );
+	}
+
+	m_sum.store( 0, std::memory_order_relaxed );
+	m_max.store( 0, std::memory_order_relaxed );
+}
+
+
+
+Instrumentation::Histogram::Summary Instrumentation::Histogram::summary() const
+{
+	std::array<uint64_t, BucketCount> buckets{};
+	uint64_t count = 0;
+
+	for( size_t i = 0; i < BucketCount; ++i )
+	{
+		buckets[i] = m_buckets[i].load( std::memory_order_relaxed );
+		count += buckets[i];
+	}
+
+	if( count == 0 )
+	{
+		return {};
+	}
+
+	const auto max = m_max.load( std::memory_order_relaxed );
+
+	return {
+		count,
+		Duration( m_sum.load( std::memory_order_relaxed ) / count ),
+		Duration( std::min( percentile( buckets, count, 50 ), max ) ),
+		Duration( std::min( percentile( buckets, count, 99 ), max ) ),
+		Duration( max )
+	};
+}
+
+
+
+size_t Instrumentation::Histogram::bucketIndex( uint64_t value )
+{
+	if( value < SubBucketCount )
+	{
+		return size_t(value);
+	}
+
+	const auto msb = 63 - __builtin_clzll( value );
+	const auto subBucket = ( value >> ( msb - SubBucketBits ) ) & ( SubBucketCount - 1 );
+
+	return std::min<size_t>( size_t( ( msb - SubBucketBits + 1 ) * SubBucketCount ) + subBucket, BucketCount - 1 );
+}
+
+
+
+uint64_t Instrumentation::Histogram::bucketValue( size_t index )
+{
+	if( index < SubBucketCount )
+	{
+		return index;
+	}
+
+	// upper bound of the bucket
+	const auto shift = index / SubBucketCount - 1;
+	const auto subBucket = index % SubBucketCount;
+
+	return ( ( SubBucketCount + subBucket + 1 ) << shift ) - 1;
+}
+
+
+
+uint64_t Instrumentation::Histogram::percentile( const std::array<uint64_t, BucketCount>& buckets,
+												 uint64_t count, int percent ) const
+{
+	const auto threshold = ( count * uint64_t(percent) + 99 ) / 100;
+
+	uint64_t cumulativeCount = 0;
+
+	for( size_t i = 0; i < BucketCount; ++i )
+	{
+		cumulativeCount += buckets[i];
+		if( cumulativeCount >= threshold )
+		{
+			return bucketValue( i );
+		}
+	}
+
+	return bucketValue( BucketCount - 1 );
+}
+
+
+
+Instrumentation::ClientHistogram Instrumentation::addClient( const std::string& name )
+{
+	auto histogram = std::make_shared<Histogram>();
+
+	std::lock_guard<std::mutex> lock( m_clientsMutex );
+	// several clients may connect from the same host
+	m_clients.emplace_back( name + "#" + std::to_string( ++m_clientId ), histogram );
+
+	return histogram;
+}
+
+
+
+void Instrumentation::removeClient( const ClientHistogram& histogram )
+{
+	std::lock_guard<std::mutex> lock( m_clientsMutex );
+
+	m_clients.erase( std::remove_if( m_clients.begin(), m_clients.end(),
+									 [&histogram]( const auto& client ) { return client.second == histogram; } ),
+					 m_clients.end() );
+}
+
+
+
+void Instrumentation::reset()
+{
+	for( auto& stage : m_stages )
+	{
+		stage.reset();
+	}
+
+	for( auto& counter : m_counters )
+	{
+		counter.store( 0, std::memory_order_relaxed );
+	}
+
+	std::lock_guard<std::mutex> lock( m_clientsMutex );
+	for( auto& client : m_clients )
+	{
+		client.second->reset();
+	}
+}
+
+
+
+Instrumentation::Report Instrumentation::report() const
+{
+	Report report;
+
+	for( size_t i = 0; i < m_stages.size(); ++i )
+	{
+		report.stages[i] = m_stages[i].summary();
+	}
+
+	for( size_t i = 0; i < m_counters.size(); ++i )
+	{
+		report.counters[i] = m_counters[i].load( std::memory_order_relaxed );
+	}
+
+	std::lock_guard<std::mutex> lock( m_clientsMutex );
+	for( const auto& client : m_clients )
+	{
+		report.clients.emplace_back( client.first, client.second->summary() );
+	}
+
+	return report;
+}
+
+
+
+const char* Instrumentation::name( Stage stage )
+{
+	switch( stage )
+	{
+	case Stage::Capture: return "capture";
+	case Stage::DamageMarking: return "damage-marking";
+	case Stage::Encode: return "encode";
+	case Stage::SocketWrite: return "socket-write";
+	case Stage::InputInjection: return "input-injection";
+	case Stage::UpdateQueueing: return "update-queueing";
+	case Stage::DamageAge: return "damage-age";
+	case Stage::Count: break;
+	}
+
+	return "unknown";
+}
+
+
+
+const char* Instrumentation::name( Counter counter )
+{
+	switch( counter )
+	{
+	case Counter::Rectangles: return "rectangles";
+	case Counter::Pixels: return "pixels";
+	case Counter::Bytes: return "bytes";
+	case Counter::Updates: return "updates";
+	case Counter::Count: break;
+	}
+
+	return "unknown";
+}
+
+
+
+std::ostream& operator<<( std::ostream& stream, const Instrumentation::Report& report )
+{
+	const auto printSummary = [&stream]( const std::string& name, const Instrumentation::Histogram::Summary& summary ) {
+		stream << name
+			   << ": n=" << summary.count
+			   << " mean=" << summary.mean.count()
+			   << "us p50=" << summary.p50.count()
+			   << "us p99=" << summary.p99.count()
+			   << "us max=" << summary.max.count() << "us\n";
+	};
+
+	for( size_t i = 0; i < report.stages.size(); ++i )
+	{
+		// leave out stages not passed at all, e.g. socket writes of backends which write while encoding
+		if( report.stages[i].count > 0 )
+		{
+			printSummary( Instrumentation::name( Instrumentation::Stage(i) ), report.stages[i] );
+		}
+	}
+
+	for( size_t i = 0; i < report.counters.size(); ++i )
+	{
+		stream << Instrumentation::name( Instrumentation::Counter(i) ) << ": " << report.counters[i] << "\n";
+	}
+
+	for( const auto& client : report.clients )
+	{
+		printSummary( "damage-age " + client.first, client.second );
+	}
+
+	return stream;
+}
+
+}
+
+}
@@ -0,0 +1,184 @@
+/*
+ * core/Instrumentation.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// lock-free timing histograms and counters for the individual stages of
+// producing and delivering a frame - cheap enough to stay enabled always
+class ANYVNC_CORE_EXPORT Instrumentation
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using Duration = std::chrono::microseconds;
+
+	enum class Stage
+	{
+		Capture,
+		DamageMarking,
+		// includes writing to the socket for backends which write while encoding
+		Encode,
+		// only recorded by backends which write encoded updates separately
+		SocketWrite,
+		InputInjection,
+		// latencies of damage from capture to hand-over to the backend and to being sent to a client
+		UpdateQueueing,
+		DamageAge,
+		Count
+	};
+
+	enum class Counter
+	{
+		Rectangles,
+		Pixels,
+		Bytes,
+		Updates,
+		Count
+	};
+
+	// log-linear histogram with four sub-buckets per power of two
+	class ANYVNC_CORE_EXPORT Histogram
+	{
+	public:
+		struct Summary
+		{
+			uint64_t count{0};
+			Duration mean{};
+			Duration p50{};
+			Duration p99{};
+			Duration max{};
+		};
+
+		void record( Duration duration );
+		void reset();
+
+		Summary summary() const;
+
+	private:
+		static constexpr auto SubBucketBits = 2;
+		static constexpr auto SubBucketCount = 1 << SubBucketBits;
+		static constexpr auto MaximumValueBits = 40;
+		static constexpr auto BucketCount = ( MaximumValueBits - 1 ) * SubBucketCount;
+
+		static size_t bucketIndex( uint64_t value );
+		static uint64_t bucketValue( size_t index );
+
+		uint64_t percentile( const std::array<uint64_t, BucketCount>& buckets, uint64_t count, int percent ) const;
+
+		std::array<std::atomic<uint64_t>, BucketCount> m_buckets{};
+		std::atomic<uint64_t> m_sum{0};
+		std::atomic<uint64_t> m_max{0};
+	};
+
+	// records the lifetime of the object in the given stage
+	class Timer
+	{
+	public:
+		Timer( Instrumentation& instrumentation, Stage stage ) :
+			m_instrumentation( instrumentation ),
+			m_stage( stage ),
+			m_start( Clock::now() )
+		{
+		}
+
+		~Timer()
+		{
+			m_instrumentation.record( m_stage, std::chrono::duration_cast<Duration>( Clock::now() - m_start ) );
+		}
+
+		Timer( const Timer& ) = delete;
+		Timer& operator=( const Timer& ) = delete;
+
+	private:
+		Instrumentation& m_instrumentation;
+		const Stage m_stage;
+		const Clock::time_point m_start;
+	};
+
+	using ClientHistogram = std::shared_ptr<Histogram>;
+
+	struct Report
+	{
+		std::array<Histogram::Summary, size_t(Stage::Count)> stages{};
+		std::array<uint64_t, size_t(Counter::Count)> counters{};
+		// damage age at send per client
+		std::vector<std::pair<std::string, Histogram::Summary>> clients{};
+	};
+
+	Instrumentation() = default;
+
+	void record( Stage stage, Duration duration )
+	{
+		m_stages[size_t(stage)].record( duration );
+	}
+
+	void add( Counter counter, uint64_t value )
+	{
+		m_counters[size_t(counter)].fetch_add( value, std::memory_order_relaxed );
+	}
+
+	// registers a per-client histogram which stays valid until removeClient()
+	ClientHistogram addClient( const std::string& name );
+	void removeClient( const ClientHistogram& histogram );
+
+	void reset();
+
+	Report report() const;
+
+	static const char* name( Stage stage );
+	static const char* name( Counter counter );
+
+private:
+	std::array<Histogram, size_t(Stage::Count)> m_stages{};
+	std::array<std::atomic<uint64_t>, size_t(Counter::Count)> m_counters{};
+
+	mutable std::mutex m_clientsMutex;
+	std::vector<std::pair<std::string, ClientHistogram>> m_clients;
+	uint64_t m_clientId{0};
+
+};
+
+ANYVNC_CORE_EXPORT std::ostream& operator<<( std::ostream& stream, const Instrumentation::Report& report );
+
+}
+
+}
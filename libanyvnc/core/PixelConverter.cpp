@@ -0,0 +1,593 @@
+/*
+ * core/PixelConverter.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ANYVNC_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define ANYVNC_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#include "PixelConverter.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// converts count pixels of one row and returns whether any destination pixel changed
+using RowKernel = bool(*)( const uint8_t* source, uint32_t* destination, int count );
+
+struct RowKernels
+{
+	RowKernel rgbx8888;
+	RowKernel rgb888;
+	RowKernel rgb565;
+};
+
+
+static constexpr uint32_t AlphaMask = 0xff000000;
+
+
+static inline uint32_t rgb565ToXrgb( uint16_t pixel )
+{
+	const uint32_t r = pixel >> 11;
+	const uint32_t g = ( pixel >> 5 ) & 0x3f;
+	const uint32_t b = pixel & 0x1f;
+
+	// replicate the upper bits so that full intensity maps to 255
+	return AlphaMask | ( ( r << 3 | r >> 2 ) << 16 ) | ( ( g << 2 | g >> 4 ) << 8 ) | ( b << 3 | b >> 2 );
+}
+
+
+template<int BYTES_PER_PIXEL>
+static inline uint32_t rgbToXrgb( const uint8_t* source )
+{
+	return AlphaMask | uint32_t( source[0] ) << 16 | uint32_t( source[1] ) << 8 | source[2];
+}
+
+
+static inline bool storeIfChanged( uint32_t* destination, uint32_t pixel )
+{
+	if( *destination != pixel )
+	{
+		*destination = pixel;
+		return true;
+	}
+
+	return false;
+}
+
+
+
+static bool convertRgbx8888Generic( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	for( int x = 0; x < count; ++x )
+	{
+		changed |= storeIfChanged( destination + x, rgbToXrgb<4>( source + x * 4 ) );
+	}
+
+	return changed;
+}
+
+
+
+static bool convertRgb888Generic( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	for( int x = 0; x < count; ++x )
+	{
+		changed |= storeIfChanged( destination + x, rgbToXrgb<3>( source + x * 3 ) );
+	}
+
+	return changed;
+}
+
+
+
+static bool convertRgb565Generic( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	for( int x = 0; x < count; ++x )
+	{
+		uint16_t pixel;
+		memcpy( &pixel, source + x * 2, sizeof(pixel) );
+		changed |= storeIfChanged( destination + x, rgb565ToXrgb( pixel ) );
+	}
+
+	return changed;
+}
+
+
+
+#ifdef ANYVNC_X86_KERNELS
+
+__attribute__((target("sse2")))
+static inline bool storeIfChangedSse2( uint32_t* destination, __m128i pixels )
+{
+	const auto target = reinterpret_cast<__m128i *>( destination );
+	const auto equal = _mm_cmpeq_epi32( pixels, _mm_loadu_si128( target ) );
+	if( _mm_movemask_epi8( equal ) != 0xffff )
+	{
+		_mm_storeu_si128( target, pixels );
+		return true;
+	}
+
+	return false;
+}
+
+
+
+__attribute__((target("sse2")))
+static bool convertRgbx8888Sse2( const uint8_t* source, uint32_t* destination, int count )
+{
+	const auto alpha = _mm_set1_epi32( int(AlphaMask) );
+	const auto lowByte = _mm_set1_epi32( 0x000000ff );
+	const auto greenByte = _mm_set1_epi32( 0x0000ff00 );
+
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 4 <= count; x += 4 )
+	{
+		// R G B X bytes -> B G R A bytes (0xAARRGGBB)
+		const auto pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + x * 4 ) );
+		const auto red = _mm_slli_epi32( _mm_and_si128( pixels, lowByte ), 16 );
+		const auto green = _mm_and_si128( pixels, greenByte );
+		const auto blue = _mm_and_si128( _mm_srli_epi32( pixels, 16 ), lowByte );
+		changed |= storeIfChangedSse2( destination + x,
+									   _mm_or_si128( _mm_or_si128( red, green ), _mm_or_si128( blue, alpha ) ) );
+	}
+
+	return convertRgbx8888Generic( source + x * 4, destination + x, count - x ) || changed;
+}
+
+
+
+__attribute__((target("sse2")))
+static bool convertRgb565Sse2( const uint8_t* source, uint32_t* destination, int count )
+{
+	const auto mask0xf8 = _mm_set1_epi16( 0xf8 );
+	const auto mask0xfc = _mm_set1_epi16( 0xfc );
+	const auto mask0x07 = _mm_set1_epi16( 0x07 );
+	const auto mask0x03 = _mm_set1_epi16( 0x03 );
+	const auto alpha = _mm_set1_epi16( short(0xff00) );
+
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 8 <= count; x += 8 )
+	{
+		const auto pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + x * 2 ) );
+
+		const auto red = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( pixels, 8 ), mask0xf8 ), _mm_srli_epi16( pixels, 13 ) );
+		const auto green = _mm_or_si128( _mm_and_si128( _mm_srli_epi16( pixels, 3 ), mask0xfc ),
+										 _mm_and_si128( _mm_srli_epi16( pixels, 9 ), mask0x03 ) );
+		const auto blue = _mm_or_si128( _mm_and_si128( _mm_slli_epi16( pixels, 3 ), mask0xf8 ),
+										_mm_and_si128( _mm_srli_epi16( pixels, 2 ), mask0x07 ) );
+
+		// low halves 0xGGBB, high halves 0xAARR
+		const auto low = _mm_or_si128( _mm_slli_epi16( green, 8 ), blue );
+		const auto high = _mm_or_si128( alpha, red );
+
+		changed |= storeIfChangedSse2( destination + x, _mm_unpacklo_epi16( low, high ) );
+		changed |= storeIfChangedSse2( destination + x + 4, _mm_unpackhi_epi16( low, high ) );
+	}
+
+	return convertRgb565Generic( source + x * 2, destination + x, count - x ) || changed;
+}
+
+
+
+__attribute__((target("avx2")))
+static inline bool storeIfChangedAvx2( uint32_t* destination, __m256i pixels )
+{
+	const auto target = reinterpret_cast<__m256i *>( destination );
+	const auto equal = _mm256_cmpeq_epi32( pixels, _mm256_loadu_si256( target ) );
+	if( _mm256_movemask_epi8( equal ) != -1 )
+	{
+		_mm256_storeu_si256( target, pixels );
+		return true;
+	}
+
+	return false;
+}
+
+
+
+__attribute__((target("avx2")))
+static bool convertRgbx8888Avx2( const uint8_t* source, uint32_t* destination, int count )
+{
+	const auto alpha = _mm256_set1_epi32( int(AlphaMask) );
+	const auto shuffle = _mm256_setr_epi8( 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+										   2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1 );
+
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 8 <= count; x += 8 )
+	{
+		const auto pixels = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( source + x * 4 ) );
+		changed |= storeIfChangedAvx2( destination + x, _mm256_or_si256( _mm256_shuffle_epi8( pixels, shuffle ), alpha ) );
+	}
+
+	return convertRgbx8888Sse2( source + x * 4, destination + x, count - x ) || changed;
+}
+
+
+
+__attribute__((target("avx2")))
+static bool convertRgb888Avx2( const uint8_t* source, uint32_t* destination, int count )
+{
+	const auto alpha = _mm256_set1_epi32( int(AlphaMask) );
+	// each 128 bit lane holds 4 pixels in its lower 12 bytes
+	const auto shuffle = _mm256_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+										   2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 );
+
+	bool changed = false;
+	int x = 0;
+
+	// the upper lane load reads 4 bytes beyond the 8 pixels, so keep a safety margin
+	for( ; x + 10 <= count; x += 8 )
+	{
+		const auto pixels = _mm256_inserti128_si256(
+								_mm256_castsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + x * 3 ) ) ),
+								_mm_loadu_si128( reinterpret_cast<const __m128i *>( source + x * 3 + 12 ) ), 1 );
+		changed |= storeIfChangedAvx2( destination + x, _mm256_or_si256( _mm256_shuffle_epi8( pixels, shuffle ), alpha ) );
+	}
+
+	return convertRgb888Generic( source + x * 3, destination + x, count - x ) || changed;
+}
+
+
+
+__attribute__((target("avx2")))
+static bool convertRgb565Avx2( const uint8_t* source, uint32_t* destination, int count )
+{
+	const auto mask0xf8 = _mm256_set1_epi16( 0xf8 );
+	const auto mask0xfc = _mm256_set1_epi16( 0xfc );
+	const auto mask0x07 = _mm256_set1_epi16( 0x07 );
+	const auto mask0x03 = _mm256_set1_epi16( 0x03 );
+	const auto alpha = _mm256_set1_epi16( short(0xff00) );
+
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 16 <= count; x += 16 )
+	{
+		const auto pixels = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( source + x * 2 ) );
+
+		const auto red = _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi16( pixels, 8 ), mask0xf8 ),
+										  _mm256_srli_epi16( pixels, 13 ) );
+		const auto green = _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi16( pixels, 3 ), mask0xfc ),
+											_mm256_and_si256( _mm256_srli_epi16( pixels, 9 ), mask0x03 ) );
+		const auto blue = _mm256_or_si256( _mm256_and_si256( _mm256_slli_epi16( pixels, 3 ), mask0xf8 ),
+										   _mm256_and_si256( _mm256_srli_epi16( pixels, 2 ), mask0x07 ) );
+
+		const auto low = _mm256_or_si256( _mm256_slli_epi16( green, 8 ), blue );
+		const auto high = _mm256_or_si256( alpha, red );
+
+		// unpacking works per 128 bit lane, restore the pixel order afterwards
+		const auto unpackedLow = _mm256_unpacklo_epi16( low, high );
+		const auto unpackedHigh = _mm256_unpackhi_epi16( low, high );
+
+		changed |= storeIfChangedAvx2( destination + x, _mm256_permute2x128_si256( unpackedLow, unpackedHigh, 0x20 ) );
+		changed |= storeIfChangedAvx2( destination + x + 8, _mm256_permute2x128_si256( unpackedLow, unpackedHigh, 0x31 ) );
+	}
+
+	return convertRgb565Sse2( source + x * 2, destination + x, count - x ) || changed;
+}
+
+#endif
+
+
+
+#ifdef ANYVNC_NEON_KERNELS
+
+static inline bool allSet( uint8x16_t mask )
+{
+	const auto halves = vand_u8( vget_low_u8( mask ), vget_high_u8( mask ) );
+	return vget_lane_u64( vreinterpret_u64_u8( halves ), 0 ) == ~uint64_t(0);
+}
+
+
+
+static inline bool storeIfChangedNeon( uint32_t* destination, uint8x16x4_t pixels )
+{
+	const auto current = vld4q_u8( reinterpret_cast<const uint8_t *>( destination ) );
+	const auto equal = vandq_u8( vandq_u8( vceqq_u8( current.val[0], pixels.val[0] ), vceqq_u8( current.val[1], pixels.val[1] ) ),
+								 vandq_u8( vceqq_u8( current.val[2], pixels.val[2] ), vceqq_u8( current.val[3], pixels.val[3] ) ) );
+	if( allSet( equal ) == false )
+	{
+		vst4q_u8( reinterpret_cast<uint8_t *>( destination ), pixels );
+		return true;
+	}
+
+	return false;
+}
+
+
+
+static bool convertRgbx8888Neon( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 16 <= count; x += 16 )
+	{
+		const auto rgbx = vld4q_u8( source + x * 4 );
+		const uint8x16x4_t bgra{ { rgbx.val[2], rgbx.val[1], rgbx.val[0], vdupq_n_u8( 0xff ) } };
+		changed |= storeIfChangedNeon( destination + x, bgra );
+	}
+
+	return convertRgbx8888Generic( source + x * 4, destination + x, count - x ) || changed;
+}
+
+
+
+static bool convertRgb888Neon( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 16 <= count; x += 16 )
+	{
+		const auto rgb = vld3q_u8( source + x * 3 );
+		const uint8x16x4_t bgra{ { rgb.val[2], rgb.val[1], rgb.val[0], vdupq_n_u8( 0xff ) } };
+		changed |= storeIfChangedNeon( destination + x, bgra );
+	}
+
+	return convertRgb888Generic( source + x * 3, destination + x, count - x ) || changed;
+}
+
+
+
+static bool convertRgb565Neon( const uint8_t* source, uint32_t* destination, int count )
+{
+	bool changed = false;
+	int x = 0;
+
+	for( ; x + 16 <= count; x += 16 )
+	{
+		const auto pixels = vld2q_u8( source + x * 2 );
+		// de-interleaved low and high bytes of 16 pixels
+		const auto low = pixels.val[0];
+		const auto high = pixels.val[1];
+
+		const auto red = vorrq_u8( vandq_u8( high, vdupq_n_u8( 0xf8 ) ), vshrq_n_u8( high, 5 ) );
+		const auto green6 = vorrq_u8( vshlq_n_u8( vandq_u8( high, vdupq_n_u8( 0x07 ) ), 3 ), vshrq_n_u8( low, 5 ) );
+		const auto green = vorrq_u8( vshlq_n_u8( green6, 2 ), vshrq_n_u8( green6, 4 ) );
+		const auto blue5 = vandq_u8( low, vdupq_n_u8( 0x1f ) );
+		const auto blue = vorrq_u8( vshlq_n_u8( blue5, 3 ), vshrq_n_u8( blue5, 2 ) );
+
+		const uint8x16x4_t bgra{ { blue, green, red, vdupq_n_u8( 0xff ) } };
+		changed |= storeIfChangedNeon( destination + x, bgra );
+	}
+
+	return convertRgb565Generic( source + x * 2, destination + x, count - x ) || changed;
+}
+
+#endif
+
+
+
+static RowKernels rowKernels( PixelConverter::InstructionSet instructionSet )
+{
+	using InstructionSet = PixelConverter::InstructionSet;
+
+	switch( instructionSet )
+	{
+#if defined(ANYVNC_X86_KERNELS)
+	case InstructionSet::AVX2:
+		return { convertRgbx8888Avx2, convertRgb888Avx2, convertRgb565Avx2 };
+	case InstructionSet::SSE2:
+		// SSE2 has no byte shuffle which would make 24 bit conversion worthwhile
+		return { convertRgbx8888Sse2, convertRgb888Generic, convertRgb565Sse2 };
+#elif defined(ANYVNC_NEON_KERNELS)
+	case InstructionSet::NEON:
+		return { convertRgbx8888Neon, convertRgb888Neon, convertRgb565Neon };
+#endif
+	default:
+		break;
+	}
+
+	return { convertRgbx8888Generic, convertRgb888Generic, convertRgb565Generic };
+}
+
+
+
+static PixelConverter::InstructionSet selectInstructionSet()
+{
+	using InstructionSet = PixelConverter::InstructionSet;
+
+	for( auto instructionSet : { InstructionSet::AVX2, InstructionSet::SSE2, InstructionSet::NEON } )
+	{
+		if( PixelConverter::isSupported( instructionSet ) )
+		{
+			return instructionSet;
+		}
+	}
+
+	return InstructionSet::Generic;
+}
+
+
+
+PixelConverter::PixelConverter( int tileSize ) :
+	m_tileSize( std::max( tileSize, 1 ) ),
+	m_instructionSet( instructionSet() )
+{
+}
+
+
+
+void PixelConverter::setTileSize( int tileSize )
+{
+	m_tileSize = std::max( tileSize, 1 );
+}
+
+
+
+bool PixelConverter::setInstructionSet( InstructionSet instructionSet )
+{
+	if( isSupported( instructionSet ) == false )
+	{
+		return false;
+	}
+
+	m_instructionSet = instructionSet;
+
+	return true;
+}
+
+
+
+void PixelConverter::convert( SourceFormat format, const void* source, int sourceBytesPerLine,
+							  uint32_t* destination, int destinationBytesPerLine,
+							  Types::Size size, Types::Region* damage )
+{
+	const auto kernels = rowKernels( m_instructionSet );
+
+	RowKernel kernel = nullptr;
+	int bytesPerPixel = 0;
+
+	switch( format )
+	{
+	case SourceFormat::RGBA8888:
+	case SourceFormat::RGBX8888: kernel = kernels.rgbx8888; bytesPerPixel = 4; break;
+	case SourceFormat::RGB888: kernel = kernels.rgb888; bytesPerPixel = 3; break;
+	case SourceFormat::RGB565: kernel = kernels.rgb565; bytesPerPixel = 2; break;
+	}
+
+	if( kernel == nullptr || size.width() <= 0 || size.height() <= 0 )
+	{
+		return;
+	}
+
+	const auto width = size.width();
+	const auto height = size.height();
+	const auto columns = size_t( ( width + m_tileSize - 1 ) / m_tileSize );
+
+	m_firstChangedRows.assign( columns, -1 );
+	m_lastChangedRows.assign( columns, -1 );
+
+	const auto sourceBytes = reinterpret_cast<const uint8_t *>( source );
+	const auto destinationBytes = reinterpret_cast<uint8_t *>( destination );
+
+	for( int y = 0; y < height; ++y )
+	{
+		const auto sourceLine = sourceBytes + y * sourceBytesPerLine;
+		const auto destinationLine = reinterpret_cast<uint32_t *>( destinationBytes + y * destinationBytesPerLine );
+
+		for( size_t column = 0; column < columns; ++column )
+		{
+			const auto left = int(column) * m_tileSize;
+			const auto count = std::min( m_tileSize, width - left );
+
+			if( kernel( sourceLine + left * bytesPerPixel, destinationLine + left, count ) )
+			{
+				if( m_firstChangedRows[column] < 0 )
+				{
+					m_firstChangedRows[column] = y;
+				}
+				m_lastChangedRows[column] = y;
+			}
+		}
+
+		// end of tile row - report changed parts of its tiles
+		if( ( y + 1 ) % m_tileSize == 0 || y + 1 == height )
+		{
+			for( size_t column = 0; column < columns; ++column )
+			{
+				if( m_firstChangedRows[column] >= 0 )
+				{
+					const auto left = int(column) * m_tileSize;
+					damage->add( { left, m_firstChangedRows[column],
+								   std::min( left + m_tileSize, width ) - 1, m_lastChangedRows[column] } );
+					m_firstChangedRows[column] = -1;
+					m_lastChangedRows[column] = -1;
+				}
+			}
+		}
+	}
+}
+
+
+
+PixelConverter::InstructionSet PixelConverter::instructionSet()
+{
+	static const auto instructionSet = selectInstructionSet();
+	return instructionSet;
+}
+
+
+
+bool PixelConverter::isSupported( InstructionSet instructionSet )
+{
+	switch( instructionSet )
+	{
+	case InstructionSet::Generic:
+		return true;
+#if defined(ANYVNC_X86_KERNELS)
+	case InstructionSet::SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports( "sse2" );
+	case InstructionSet::AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports( "avx2" );
+#elif defined(ANYVNC_NEON_KERNELS)
+	case InstructionSet::NEON:
+		return true;
+#endif
+	default:
+		break;
+	}
+
+	return false;
+}
+
+
+
+const char* PixelConverter::name( InstructionSet instructionSet )
+{
+	switch( instructionSet )
+	{
+	case InstructionSet::Generic: return "generic";
+	case InstructionSet::SSE2: return "SSE2";
+	case InstructionSet::AVX2: return "AVX2";
+	case InstructionSet::NEON: return "NEON";
+	}
+
+	return "unknown";
+}
+
+}
+
+}
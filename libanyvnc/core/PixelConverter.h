@@ -0,0 +1,99 @@
+/*
+ * core/PixelConverter.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/Region.h"
+#include "libanyvnc/types/Size.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// converts captured images to XRGB32 and detects changes in the same pass,
+// using the best SIMD implementation available at runtime
+class ANYVNC_CORE_EXPORT PixelConverter
+{
+public:
+	enum class SourceFormat
+	{
+		RGBA8888,
+		RGBX8888,
+		RGB888,
+		RGB565
+	};
+
+	enum class InstructionSet
+	{
+		Generic,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	static constexpr auto DefaultTileSize = 64;
+
+	explicit PixelConverter( int tileSize = DefaultTileSize );
+
+	int tileSize() const
+	{
+		return m_tileSize;
+	}
+
+	void setTileSize( int tileSize );
+
+	// use other kernels than the best ones available, e.g. for comparing them -
+	// fails if the CPU doesn't support the instruction set
+	bool setInstructionSet( InstructionSet instructionSet );
+
+	// writes the converted image to destination and adds the changed rows of
+	// each tile to damage
+	void convert( SourceFormat format, const void* source, int sourceBytesPerLine,
+				  uint32_t* destination, int destinationBytesPerLine,
+				  Types::Size size, Types::Region* damage );
+
+	// instruction set used by default
+	static InstructionSet instructionSet();
+	static bool isSupported( InstructionSet instructionSet );
+	static const char* name( InstructionSet instructionSet );
+
+private:
+	int m_tileSize;
+	InstructionSet m_instructionSet;
+
+	// first and last changed row per tile of the current tile row
+	std::vector<int> m_firstChangedRows;
+	std::vector<int> m_lastChangedRows;
+
+};
+
+}
+
+}
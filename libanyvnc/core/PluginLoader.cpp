@@ -106,8 +106,10 @@ const char* PluginLoader::pluginEntryPoint()
 
 
 
-Interfaces::Plugin* PluginLoader::createInstance( const PluginTypeQualifier& qualifier )
+std::vector<filesystem::path> PluginLoader::pluginFiles()
 {
+	std::vector<filesystem::path> files;
+
 #ifdef QT_CORE_LIB
 	for( const auto& entry : QDir( applicationDirPath() + QDir::separator() + pluginPath() ).entryInfoList() )
 	{
@@ -119,11 +121,7 @@ Interfaces::Plugin* PluginLoader::createInstance( const PluginTypeQualifier& qua
 
 		if( entry.fileName().endsWith( QString::fromStdString( pluginSuffix() ) ) )
 		{
-			auto instance = loadPlugin( entry.filePath(), qualifier );
-			if( instance )
-			{
-				return instance;
-			}
+			files.push_back( entry.filePath() );
 		}
 	}
 #else
@@ -131,21 +129,57 @@ Interfaces::Plugin* PluginLoader::createInstance( const PluginTypeQualifier& qua
 	{
 		if( Utils::ends_with( entry.path().string(), pluginSuffix() ) )
 		{
-			auto instance = loadPlugin( entry.path().string(), qualifier );
-			if( instance )
-			{
-				return instance;
-			}
-
+			files.push_back( entry.path().string() );
 		}
 	}
 #endif
 
+	return files;
+}
+
+
+
+void PluginLoader::reportUnavailablePlugin( const std::string& uid, const char* reason )
+{
+	std::cerr << "requested plugin " << uid << " " << reason << std::endl;
+}
+
+
+
+Interfaces::Plugin* PluginLoader::createInstance( const PluginTypeQualifier& qualifier )
+{
+	for( const auto& file : pluginFiles() )
+	{
+		auto instance = loadPlugin( file, qualifier );
+		if( instance )
+		{
+			return instance;
+		}
+	}
+
 	return nullptr;
 }
 
 
 
+Interfaces::Plugins PluginLoader::createInstances( const PluginTypeQualifier& qualifier )
+{
+	Interfaces::Plugins instances;
+
+	for( const auto& file : pluginFiles() )
+	{
+		auto instance = loadPlugin( file, qualifier );
+		if( instance )
+		{
+			instances.push_back( instance );
+		}
+	}
+
+	return instances;
+}
+
+
+
 Interfaces::Plugin* PluginLoader::loadPlugin( const filesystem::path& path, const PluginTypeQualifier& qualifier )
 {
 #ifdef QT_CORE_LIB
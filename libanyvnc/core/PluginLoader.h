@@ -22,7 +22,10 @@
  *
  */
 
+#include <algorithm>
 #include <functional>
+#include <string>
+#include <vector>
 #include "libanyvnc/core/AnyVncCore.h"
 #include "libanyvnc/core/Filesystem.h"
 #include "libanyvnc/interfaces/Plugin.h"
@@ -38,15 +41,24 @@ class ANYVNC_CORE_EXPORT PluginLoader
 public:
 	PluginLoader() = default;
 
+	// uid may also be the name of the plugin to prefer
 	template<class T>
-	static T* create( const std::string& uid = {} )
+	static T* create( const std::string& uid = {}, const std::vector<std::string>& excludedUids = {} )
 	{
-		const auto checkInstanceType = []( auto instance ) -> bool { return dynamic_cast<T *>( instance ) != nullptr; };
+		const auto checkInstanceType = [&excludedUids]( auto instance ) -> bool {
+			return dynamic_cast<T *>( instance ) != nullptr &&
+					std::find( excludedUids.begin(), excludedUids.end(), instance->uid() ) == excludedUids.end();
+		};
+		const auto isSelectable = [&checkInstanceType]( auto instance ) -> bool {
+			return checkInstanceType( instance ) &&
+					bool( instance->flags() & Interfaces::Plugin::Flag::RequiresExplicitSelection ) == false;
+		};
 
 		for( const auto& qualifier : std::initializer_list<PluginTypeQualifier> {
-				 [&checkInstanceType, &uid]( auto instance ) { return checkInstanceType( instance ) && instance->uid() == uid; },
-				 [&checkInstanceType]( auto instance ) { return checkInstanceType( instance ) && instance->flags() & Interfaces::Plugin::Flag::ProvidesDefaultImplementation; },
-				 checkInstanceType
+				 [&checkInstanceType, &uid]( auto instance ) { return checkInstanceType( instance ) && uid.empty() == false &&
+																( instance->uid() == uid || instance->name() == uid ); },
+				 [&isSelectable]( auto instance ) { return isSelectable( instance ) && instance->flags() & Interfaces::Plugin::Flag::ProvidesDefaultImplementation; },
+				 isSelectable
 			 } )
 		{
 			auto instance = dynamic_cast<T *>( createInstance( qualifier ) );
@@ -59,18 +71,76 @@ public:
 		return nullptr;
 	}
 
+	// uid may also be the name of the plugin - if given, only this plugin is
+	// used and nullptr is returned if it is not available
 	template<class T, class C>
-	static T* createAndInitialize( C* component )
+	static T* createAndInitialize( C* component, const std::string& uid = {} )
 	{
-		T* instance = create<T>();
-		if( instance && instance->initialize( component ) )
+		if( uid.empty() == false )
 		{
+			// never replace an explicitly selected plugin silently, e.g. a synthetic
+			// framebuffer for load testing by the actual screen
+			auto instance = dynamic_cast<T *>( createInstance( [&uid]( auto instance ) {
+				return dynamic_cast<T *>( instance ) != nullptr &&
+						( instance->uid() == uid || instance->name() == uid ); } ) );
+			if( instance == nullptr )
+			{
+				reportUnavailablePlugin( uid, "not found" );
+				return nullptr;
+			}
+
+			if( instance->initialize( component ) == false )
+			{
+				reportUnavailablePlugin( uid, "failed to initialize" );
+				delete instance;
+				return nullptr;
+			}
+
 			return instance;
 		}
 
+		// fall back to other implementations if the default one can't be
+		// used in the current environment (e.g. no X11 display available)
+		std::vector<std::string> failedUids;
+
+		while( auto instance = create<T>( {}, failedUids ) )
+		{
+			if( instance->initialize( component ) )
+			{
+				return instance;
+			}
+
+			failedUids.push_back( instance->uid() );
+			delete instance;
+		}
+
 		return nullptr;
 	}
 
+	// all successfully initialized implementations of T which don't require explicit selection
+	template<class T, class C>
+	static std::vector<T *> createAllAndInitialize( C* component )
+	{
+		std::vector<T *> instances;
+
+		for( auto plugin : createInstances( []( auto instance ) {
+				 return dynamic_cast<T *>( instance ) != nullptr &&
+						 bool( instance->flags() & Interfaces::Plugin::Flag::RequiresExplicitSelection ) == false; } ) )
+		{
+			auto instance = dynamic_cast<T *>( plugin );
+			if( instance->initialize( component ) )
+			{
+				instances.push_back( instance );
+			}
+			else
+			{
+				delete instance;
+			}
+		}
+
+		return instances;
+	}
+
 	static filesystem::path applicationFilePath();
 	static filesystem::path applicationDirPath();
 
@@ -81,8 +151,11 @@ private:
 	static filesystem::path pluginPath();
 	static std::string pluginSuffix();
 	static const char* pluginEntryPoint();
+	static std::vector<filesystem::path> pluginFiles();
+	static void reportUnavailablePlugin( const std::string& uid, const char* reason );
 
 	static Interfaces::Plugin* createInstance( const PluginTypeQualifier& qualifier );
+	static Interfaces::Plugins createInstances( const PluginTypeQualifier& qualifier );
 	static Interfaces::Plugin* loadPlugin( const filesystem::path& path, const PluginTypeQualifier& qualifier );
 
 };
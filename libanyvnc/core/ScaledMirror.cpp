@@ -0,0 +1,139 @@
+/*
+ * ScaledMirror.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "ScaledMirror.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+ScaledMirror::ScaledMirror( int scale ) :
+	m_scale( std::max( scale, 1 ) )
+{
+}
+
+
+
+Types::Size ScaledMirror::scaledSize( Types::Size sourceSize ) const
+{
+	return { std::max( ( sourceSize.width() + m_scale - 1 ) / m_scale, 1 ),
+			 std::max( ( sourceSize.height() + m_scale - 1 ) / m_scale, 1 ) };
+}
+
+
+
+Types::Region ScaledMirror::update( const Types::Image& source, int bytesPerPixel, const Types::Region& damage )
+{
+	Types::Region scaledDamage;
+
+	if( source.size() != m_sourceSize || bytesPerPixel != m_bytesPerPixel )
+	{
+		const auto size = scaledSize( source.size() );
+
+		m_sourceSize = source.size();
+		m_bytesPerPixel = bytesPerPixel;
+		m_image = Types::Image( size, size.width() * bytesPerPixel );
+
+		const Types::Rectangle area{ 0, 0, size.width() - 1, size.height() - 1 };
+		scaleArea( source, area );
+		scaledDamage.add( area );
+
+		return scaledDamage;
+	}
+
+	// each damaged source pixel affects the mirror pixel covering its block
+	for( const auto& rect : damage.rectangles() )
+	{
+		scaledDamage.add( { rect.left() / m_scale, rect.top() / m_scale,
+							rect.right() / m_scale, rect.bottom() / m_scale } );
+	}
+
+	const auto size = m_image.size();
+	scaledDamage = scaledDamage.intersected( { 0, 0, size.width() - 1, size.height() - 1 } );
+
+	for( const auto& rect : scaledDamage.rectangles() )
+	{
+		scaleArea( source, rect );
+	}
+
+	return scaledDamage;
+}
+
+
+
+void ScaledMirror::scaleArea( const Types::Image& source, const Types::Rectangle& area )
+{
+	const auto sourceWidth = m_sourceSize.width();
+	const auto sourceHeight = m_sourceSize.height();
+	const auto bytesPerPixel = size_t(m_bytesPerPixel);
+
+	for( int y = area.top(); y <= area.bottom(); ++y )
+	{
+		const auto top = y * m_scale;
+		const auto bottom = std::min( top + m_scale, sourceHeight );
+		auto destination = m_image.scanLine( y ) + size_t(area.left()) * bytesPerPixel;
+
+		for( int x = area.left(); x <= area.right(); ++x, destination += bytesPerPixel )
+		{
+			const auto left = x * m_scale;
+			const auto right = std::min( left + m_scale, sourceWidth );
+
+			if( bytesPerPixel != 4 )
+			{
+				memcpy( destination, source.scanLine( top ) + size_t(left) * bytesPerPixel, bytesPerPixel );
+				continue;
+			}
+
+			// box filter - partial blocks at the right and bottom edges are
+			// averaged over the existing pixels only
+			uint32_t sums[4] = {};
+			for( int sourceY = top; sourceY < bottom; ++sourceY )
+			{
+				auto pixel = source.scanLine( sourceY ) + size_t(left) * 4;
+				for( int sourceX = left; sourceX < right; ++sourceX, pixel += 4 )
+				{
+					sums[0] += pixel[0];
+					sums[1] += pixel[1];
+					sums[2] += pixel[2];
+					sums[3] += pixel[3];
+				}
+			}
+
+			const auto count = uint32_t( ( right - left ) * ( bottom - top ) );
+			for( int i = 0; i < 4; ++i )
+			{
+				destination[i] = uint8_t( ( sums[i] + count / 2 ) / count );
+			}
+		}
+	}
+}
+
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * ScaledMirror.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/Image.h"
+#include "libanyvnc/types/Region.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// downscaled copy of the framebuffer for thumbnail viewers which is only
+// refreshed in damaged areas - 32 bit pixels are averaged per byte (i.e. per
+// channel for all common formats), other formats are point sampled
+class ANYVNC_CORE_EXPORT ScaledMirror
+{
+public:
+	explicit ScaledMirror( int scale );
+
+	int scale() const
+	{
+		return m_scale;
+	}
+
+	Types::Size size() const
+	{
+		return m_image.size();
+	}
+
+	int bytesPerLine() const
+	{
+		return m_image.bytesPerLine();
+	}
+
+	uint8_t* data()
+	{
+		return m_image.data();
+	}
+
+	const Types::Image& image() const
+	{
+		return m_image;
+	}
+
+	// downscaled size of a source of the given size
+	Types::Size scaledSize( Types::Size sourceSize ) const;
+
+	// refreshes the parts of the mirror covering damage and returns them -
+	// changed source geometry refreshes the whole mirror
+	Types::Region update( const Types::Image& source, int bytesPerPixel, const Types::Region& damage );
+
+private:
+	void scaleArea( const Types::Image& source, const Types::Rectangle& area );
+
+	int m_scale;
+	int m_bytesPerPixel{0};
+	Types::Size m_sourceSize{};
+	Types::Image m_image{ Types::Size{ 0, 0 }, 0 };
+
+};
+
+}
+
+}
@@ -0,0 +1,295 @@
+/*
+ * ScrollDetector.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "ScrollDetector.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+static constexpr uint64_t HashSeed = 0xCBF29CE484222325ULL;
+static constexpr uint64_t HashPrime = 0x9E3779B97F4A7C15ULL;
+
+
+static inline uint64_t mix( uint64_t hash, uint64_t value )
+{
+	hash = ( hash ^ value ) * HashPrime;
+	return hash ^ ( hash >> 29 );
+}
+
+
+static inline uint64_t readBytes( const uint8_t* data, size_t count )
+{
+	uint64_t value = 0;
+	memcpy( &value, data, count );
+	return value;
+}
+
+
+
+void ScrollDetector::reset()
+{
+	m_valid = false;
+	m_previousFrame.clear();
+}
+
+
+
+void ScrollDetector::detect( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+							 Types::Region* damage, Types::Moves* moves )
+{
+	const auto frame = reinterpret_cast<const uint8_t *>( data );
+
+	if( m_valid == false || size != m_size ||
+		bytesPerLine != m_bytesPerLine || bytesPerPixel != m_bytesPerPixel )
+	{
+		m_size = size;
+		m_bytesPerLine = bytesPerLine;
+		m_bytesPerPixel = bytesPerPixel;
+		m_previousFrame.assign( frame, frame + size_t(bytesPerLine) * size_t(std::max( size.height(), 0 )) );
+		m_valid = true;
+		return;
+	}
+
+	auto changedRegion = *damage;
+	for( const auto& move : *moves )
+	{
+		changedRegion.add( move.destination() );
+	}
+
+	if( moves->empty() && damage->isEmpty() == false )
+	{
+		Types::Region remainingDamage;
+		Types::Moves detectedMoves;
+
+		for( const auto& rect : damage->rectangles() )
+		{
+			Types::Rectangle destination;
+			int offset = 0;
+
+			if( rect.height() >= MinimumMoveLength &&
+				findMove( frame, rect, Direction::Vertical, &destination, &offset ) )
+			{
+				detectedMoves.emplace_back( destination, 0, offset );
+				remainingDamage.add( { rect.left(), rect.top(), rect.right(), destination.top() - 1 } );
+				remainingDamage.add( { rect.left(), destination.bottom() + 1, rect.right(), rect.bottom() } );
+			}
+			else if( rect.width() >= MinimumMoveLength &&
+					 findMove( frame, rect, Direction::Horizontal, &destination, &offset ) )
+			{
+				detectedMoves.emplace_back( destination, offset, 0 );
+				remainingDamage.add( { rect.left(), rect.top(), destination.left() - 1, rect.bottom() } );
+				remainingDamage.add( { destination.right() + 1, rect.top(), rect.right(), rect.bottom() } );
+			}
+			else
+			{
+				remainingDamage.add( rect );
+			}
+		}
+
+		// sources and destinations all lie within distinct damaged rectangles
+		// so the order in which clients apply the moves does not matter
+		if( detectedMoves.empty() == false )
+		{
+			*damage = std::move(remainingDamage);
+			*moves = std::move(detectedMoves);
+		}
+	}
+
+	storeFrame( frame, changedRegion );
+}
+
+
+
+bool ScrollDetector::findMove( const uint8_t* data, const Types::Rectangle& rect, Direction direction,
+							   Types::Rectangle* destination, int* offset )
+{
+	hashLines( m_previousFrame.data(), rect, direction, &m_previousHashes );
+	hashLines( data, rect, direction, &m_currentHashes );
+
+	const auto& previous = m_previousHashes;
+	const auto& current = m_currentHashes;
+	const auto count = int(current.size());
+
+	// lines which occur more than once (e.g. plain background) are ambiguous
+	m_lineIndices.clear();
+	for( int i = 0; i < count; ++i )
+	{
+		const auto result = m_lineIndices.emplace( previous[size_t(i)], i );
+		if( result.second == false )
+		{
+			result.first->second = -1;
+		}
+	}
+
+	// each changed line which occurred once before votes for its offset
+	m_votes.clear();
+	int bestOffset = 0;
+	int bestVotes = 0;
+
+	for( int i = 0; i < count; ++i )
+	{
+		if( current[size_t(i)] == previous[size_t(i)] )
+		{
+			continue;
+		}
+
+		const auto it = m_lineIndices.find( current[size_t(i)] );
+		if( it != m_lineIndices.end() && it->second >= 0 )
+		{
+			const auto votes = ++m_votes[i - it->second];
+			if( votes > bestVotes )
+			{
+				bestVotes = votes;
+				bestOffset = i - it->second;
+			}
+		}
+	}
+
+	if( bestVotes < MinimumMatchingLines )
+	{
+		return false;
+	}
+
+	// longest run of lines matching the previous ones at the winning offset
+	int runStart = 0;
+	int runLength = 0;
+	int bestStart = 0;
+	int bestLength = 0;
+
+	for( int i = std::max( bestOffset, 0 ); i < std::min( count, count + bestOffset ); ++i )
+	{
+		if( current[size_t(i)] != previous[size_t(i - bestOffset)] )
+		{
+			runLength = 0;
+			continue;
+		}
+
+		if( runLength++ == 0 )
+		{
+			runStart = i;
+		}
+
+		if( runLength > bestLength )
+		{
+			bestLength = runLength;
+			bestStart = runStart;
+		}
+	}
+
+	if( bestLength < MinimumMoveLength )
+	{
+		return false;
+	}
+
+	*offset = bestOffset;
+
+	if( direction == Direction::Vertical )
+	{
+		*destination = { rect.left(), rect.top() + bestStart, rect.right(), rect.top() + bestStart + bestLength - 1 };
+	}
+	else
+	{
+		*destination = { rect.left() + bestStart, rect.top(), rect.left() + bestStart + bestLength - 1, rect.bottom() };
+	}
+
+	return true;
+}
+
+
+
+void ScrollDetector::hashLines( const uint8_t* data, const Types::Rectangle& rect, Direction direction,
+								std::vector<uint64_t>* hashes ) const
+{
+	const auto bytesPerPixel = size_t(m_bytesPerPixel);
+	const auto rowOffset = size_t(rect.left()) * bytesPerPixel;
+	const auto rowLength = size_t(rect.width()) * bytesPerPixel;
+
+	if( direction == Direction::Vertical )
+	{
+		hashes->resize( size_t(rect.height()) );
+
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			const auto row = data + size_t(y) * size_t(m_bytesPerLine) + rowOffset;
+
+			auto hash = HashSeed;
+			size_t i = 0;
+			for( ; i + sizeof(uint64_t) <= rowLength; i += sizeof(uint64_t) )
+			{
+				hash = mix( hash, readBytes( row + i, sizeof(uint64_t) ) );
+			}
+			if( i < rowLength )
+			{
+				hash = mix( hash, readBytes( row + i, rowLength - i ) );
+			}
+
+			(*hashes)[size_t(y - rect.top())] = hash;
+		}
+	}
+	else
+	{
+		// walk rows in memory order and hash all columns in parallel
+		hashes->assign( size_t(rect.width()), HashSeed );
+
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			const auto row = data + size_t(y) * size_t(m_bytesPerLine) + rowOffset;
+
+			for( size_t x = 0; x < size_t(rect.width()); ++x )
+			{
+				(*hashes)[x] = mix( (*hashes)[x], readBytes( row + x * bytesPerPixel, bytesPerPixel ) );
+			}
+		}
+	}
+}
+
+
+
+void ScrollDetector::storeFrame( const uint8_t* data, const Types::Region& region )
+{
+	const auto bytesPerLine = size_t(m_bytesPerLine);
+	const auto bytesPerPixel = size_t(m_bytesPerPixel);
+
+	for( const auto& rect : region.intersected( { 0, 0, m_size.width() - 1, m_size.height() - 1 } ).rectangles() )
+	{
+		const auto offset = size_t(rect.left()) * bytesPerPixel;
+		const auto length = size_t(rect.width()) * bytesPerPixel;
+
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			memcpy( m_previousFrame.data() + size_t(y) * bytesPerLine + offset,
+					data + size_t(y) * bytesPerLine + offset, length );
+		}
+	}
+}
+
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * ScrollDetector.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/Move.h"
+#include "libanyvnc/types/Region.h"
+#include "libanyvnc/types/Size.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// finds vertically or horizontally scrolled content within damaged rectangles
+// by matching hashes of their lines against the ones of the previous frame
+class ANYVNC_CORE_EXPORT ScrollDetector
+{
+public:
+	// shorter runs of moved lines are cheaper to re-encode than to track
+	static constexpr auto MinimumMoveLength = 32;
+
+	// discards the previous frame so the next call of detect() only stores it
+	void reset();
+
+	// replaces the moved parts of damage with moves - moves reported by the
+	// framebuffer itself are kept as they are and only the previous frame is updated
+	void detect( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+				 Types::Region* damage, Types::Moves* moves );
+
+private:
+	static constexpr auto MinimumMatchingLines = 8;
+
+	enum class Direction
+	{
+		Vertical,
+		Horizontal
+	};
+
+	bool findMove( const uint8_t* data, const Types::Rectangle& rect, Direction direction,
+				   Types::Rectangle* destination, int* offset );
+	void hashLines( const uint8_t* data, const Types::Rectangle& rect, Direction direction,
+					std::vector<uint64_t>* hashes ) const;
+	void storeFrame( const uint8_t* data, const Types::Region& region );
+
+	Types::Size m_size{};
+	int m_bytesPerLine{0};
+	int m_bytesPerPixel{0};
+	bool m_valid{false};
+
+	std::vector<uint8_t> m_previousFrame;
+	std::vector<uint64_t> m_previousHashes;
+	std::vector<uint64_t> m_currentHashes;
+	std::unordered_map<uint64_t, int> m_lineIndices;
+	std::unordered_map<int, int> m_votes;
+
+};
+
+}
+
+}
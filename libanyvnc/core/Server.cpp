@@ -22,6 +22,8 @@
  *
  */
 
+#include <algorithm>
+
 #include "Server.h"
 #include "PluginLoader.h"
 
@@ -33,35 +35,44 @@ namespace Core
 
 bool Server::run()
 {
-	if( createFramebuffer() == false ||
-		createKeyboard() == false ||
-		createPointingDevice() == false ||
-		createClipboard() == false ||
-		createBackend() == false )
+	if( createPlugins() == false )
 	{
 		shutdown();
 		return false;
 	}
 
 	m_quit = false;
+	m_hosted = false;
+
+	startCapturing();
 
-	// TODO: multi-monitor support
-	while( m_quit == false &&
-		   m_framebuffer->size() == m_framebuffer->availableScreens().at(0).geometry() )
+	bool result = true;
+
+	while( m_quit == false )
 	{
-		auto timeout = IdleTimeout;
-		if( m_backend->hasConnectedClients() )
+		updateClientState();
+		updateCaptureArea();
+
+		// block until client sockets become readable or captured updates are available
+		m_backend->waitForEvents( IdleTimeout, m_updateAvailable.handle() );
+		m_updateAvailable.reset();
+
+		// inject input first so that the capture stage can pick up its effects right away
+		m_backend->processInputEvents();
+
+		if( processCapturedUpdates() == false &&
+			restartFramebuffer() == false )
 		{
-			timeout = NonIdleTimeout;
-			m_backend->handleFramebufferUpdate();
+			result = false;
+			break;
 		}
 
-		m_backend->processEvents( timeout );
+		processNetworkEvents();
 	}
 
 	shutdown();
 
-	return true;
+	return result;
 }
 
 
@@ -73,11 +84,681 @@ void Server::quit()
 
 
 
+Server::PipelineStatistics Server::pipelineStatistics() const
+{
+	return {
+		m_updateQueue.depth(),
+		m_updateQueue.maxDepth(),
+		m_updateQueue.pushed(),
+		m_updateQueue.stalls(),
+		m_pendingClientUpdates,
+		m_governor.frameRate()
+	};
+}
+
+
+
+bool Server::startSession()
+{
+	if( createPlugins() == false )
+	{
+		shutdown();
+		return false;
+	}
+
+	m_quit = false;
+	m_hosted = true;
+
+	startCapturing();
+
+	return true;
+}
+
+
+
+void Server::collectEventHandles( std::vector<Types::EventHandle>* handles, int* timeout ) const
+{
+	m_backend->collectEventHandles( handles );
+
+	if( m_clientsConnected == false )
+	{
+		return;
+	}
+
+	const auto damageEvent = m_framebuffer->damageEvent();
+	if( damageEvent != Types::InvalidEventHandle && m_damagePending == false )
+	{
+		handles->push_back( damageEvent );
+	}
+	else if( m_damagePending || m_updatesRequested )
+	{
+		// polling framebuffers and deferred damage are due after the governed frame interval
+		*timeout = std::min( *timeout, captureDelay() );
+	}
+}
+
+
+
+bool Server::serviceSession()
+{
+	m_backend->processInputEvents();
+
+	updateClientState();
+	const auto captureAreaChanged = updateCaptureArea();
+
+	if( m_clientsConnected )
+	{
+		handleInputInjection();
+
+		const auto damageEvent = m_framebuffer->damageEvent();
+		if( damageEvent == Types::InvalidEventHandle )
+		{
+			m_damagePending = m_updatesRequested.load();
+		}
+		else if( captureAreaChanged || Event::wait( damageEvent, 0 ) )
+		{
+			m_damagePending = true;
+		}
+
+		if( m_damagePending && captureDelay() == 0 )
+		{
+			m_damagePending = false;
+			capture();
+		}
+	}
+	else
+	{
+		m_captureState.pendingUpdate = {};
+		m_damagePending = false;
+	}
+
+	queuePendingUpdate();
+
+	if( processCapturedUpdates() == false &&
+		restartFramebuffer() == false )
+	{
+		return false;
+	}
+
+	processNetworkEvents();
+
+	return true;
+}
+
+
+
+void Server::updateClientState()
+{
+	const auto hasConnectedClients = m_backend->hasConnectedClients();
+	const auto updatesRequested = hasConnectedClients && m_backend->hasPendingClientUpdateRequests();
+	if( hasConnectedClients != m_clientsConnected ||
+		updatesRequested != m_updatesRequested )
+	{
+		if( updatesRequested && m_updatesRequested == false && m_clientsConnected )
+		{
+			m_governor.reportRoundTrip( std::chrono::duration_cast<FrameRateGovernor::Duration>(
+											FrameRateGovernor::Clock::now() - m_lastUpdateSent ) );
+		}
+		else if( updatesRequested == false && m_updatesRequested )
+		{
+			m_lastUpdateSent = FrameRateGovernor::Clock::now();
+		}
+
+		m_clientsConnected = hasConnectedClients;
+		m_updatesRequested = updatesRequested;
+		m_captureWakeup.signal();
+	}
+}
+
+
+
+void Server::processNetworkEvents()
+{
+	const auto processingStart = FrameRateGovernor::Clock::now();
+	m_backend->processEvents( 0 );
+	m_pendingClientUpdates = m_backend->pendingClientUpdates();
+
+	if( m_unsentPixels > 0 )
+	{
+		m_encodeTime += std::chrono::duration_cast<FrameRateGovernor::Duration>(
+							FrameRateGovernor::Clock::now() - processingStart );
+
+		if( m_pendingClientUpdates == 0 )
+		{
+			m_governor.reportEncode( m_encodeTime, m_unsentPixels );
+			m_encodeTime = {};
+			m_unsentPixels = 0;
+		}
+	}
+}
+
+
+
+bool Server::restartFramebuffer()
+{
+	// only recreate the framebuffer and let the backend switch to it so that
+	// clients stay connected
+	stopCapturing();
+
+	destroyFramebuffer();
+
+	if( createFramebuffer() == false ||
+		m_backend->reconfigure() == false )
+	{
+		return false;
+	}
+
+	startCapturing();
+
+	return true;
+}
+
+
+
+bool Server::updateCaptureArea()
+{
+	const auto viewedArea = m_backend->viewedArea();
+
+	std::lock_guard<std::mutex> lock( m_captureAreaMutex );
+	if( viewedArea == m_captureArea )
+	{
+		return false;
+	}
+
+	m_captureArea = viewedArea;
+	m_captureAreaChanged = true;
+
+	// the newly exposed area has to be captured even if nothing gets damaged
+	m_captureWakeup.signal();
+
+	return true;
+}
+
+
+
+void Server::startCapturing()
+{
+	m_updateQueue.open();
+	m_snapshotBuffers.open();
+	m_governor.reset();
+	m_unsentPixels = 0;
+	m_encodeTime = {};
+	m_lastUpdateSent = FrameRateGovernor::Clock::now();
+	m_captureWakeup.reset();
+	m_updateAvailable.reset();
+
+	m_clientsConnected = false;
+	m_updatesRequested = false;
+	m_captureRunning = true;
+	m_captureArea = {};
+	m_captureAreaChanged = false;
+
+	m_captureState = {};
+	m_scrollDetector.reset();
+	m_captureState.framebufferSize = m_framebuffer->size();
+	m_captureState.pixelFormat = m_framebuffer->pixelFormat();
+	m_captureState.screens = m_framebuffer->availableScreens();
+	m_captureState.lastCapture = FrameRateGovernor::Clock::now() - FrameRateGovernor::Duration( std::chrono::seconds(1) );
+	m_damagePending = false;
+	m_inputInjected = false;
+
+	// hosted sessions capture on the worker pool of their SessionHost
+	if( m_hosted == false )
+	{
+		m_captureThread = std::thread( [this]() { captureLoop(); } );
+	}
+}
+
+
+
+void Server::stopCapturing()
+{
+	m_captureRunning = false;
+	m_updateQueue.close();
+	m_snapshotBuffers.close();
+	m_captureWakeup.signal();
+
+	if( m_captureThread.joinable() )
+	{
+		m_captureThread.join();
+	}
+
+	// release the snapshots of updates which will never be processed
+	m_updateQueue.clear();
+}
+
+
+
+void Server::captureLoop()
+{
+	while( m_captureRunning )
+	{
+		if( m_clientsConnected == false )
+		{
+			m_captureState.pendingUpdate = {};
+			m_captureWakeup.wait( IdleTimeout );
+			m_captureWakeup.reset();
+			continue;
+		}
+
+		handleInputInjection();
+
+		const auto damageEvent = m_framebuffer->damageEvent();
+		if( damageEvent == Types::InvalidEventHandle )
+		{
+			// polling framebuffers capture and compare the whole screen on each
+			// update() call so only do this while clients are waiting for updates
+			if( m_updatesRequested == false )
+			{
+				m_captureWakeup.wait( IdleTimeout );
+				m_captureWakeup.reset();
+				continue;
+			}
+
+			const auto delay = captureDelay();
+			if( delay > 0 )
+			{
+				m_captureWakeup.wait( delay );
+				m_captureWakeup.reset();
+				continue;
+			}
+
+			capture();
+		}
+		else
+		{
+			// keep collecting reported damage so nothing is lost while clients
+			// are busy, the wakeup event signals changed demand
+			const auto signaledEvent = Event::waitForAny( { damageEvent, m_captureWakeup.handle() }, IdleTimeout );
+			m_captureWakeup.reset();
+
+			bool captureAreaChanged = false;
+			{
+				std::lock_guard<std::mutex> lock( m_captureAreaMutex );
+				captureAreaChanged = m_captureAreaChanged;
+			}
+
+			if( signaledEvent == 0 || captureAreaChanged )
+			{
+				// let further damage accumulate until the governed frame interval has elapsed
+				const auto delay = captureDelay();
+				if( delay > 0 )
+				{
+					m_captureWakeup.wait( delay );
+					m_captureWakeup.reset();
+				}
+
+				capture();
+			}
+		}
+
+		if( queuePendingUpdate() == false )
+		{
+			break;
+		}
+	}
+}
+
+
+
+int Server::captureDelay() const
+{
+	const auto now = FrameRateGovernor::Clock::now();
+
+	// milliseconds to wait until the governed frame interval has elapsed - shortly
+	// after input only the maximum frame rate applies to keep interaction responsive
+	const auto interval = now < m_captureState.inputBoostEnd ? m_governor.minimumFrameInterval() :
+															   m_governor.frameInterval();
+	const auto nextCapture = m_captureState.lastCapture + interval;
+	if( nextCapture <= now )
+	{
+		return 0;
+	}
+
+	return int( std::chrono::ceil<std::chrono::milliseconds>( nextCapture - now ).count() );
+}
+
+
+
+bool Server::handleInputInjection()
+{
+	if( m_inputInjected.exchange( false ) == false )
+	{
+		return false;
+	}
+
+	// allow an immediate capture and boost the frame rate while the screen reacts to the input
+	m_captureState.lastCapture = {};
+	m_captureState.inputBoostEnd = FrameRateGovernor::Clock::now() + InputBoostDuration;
+
+	return true;
+}
+
+
+
+void Server::capture()
+{
+	using UpdateFlag = Framebuffer::UpdateFlag;
+
+	auto& state = m_captureState;
+
+	Types::Region exposedArea;
+
+	{
+		std::lock_guard<std::mutex> lock( m_captureAreaMutex );
+		if( m_captureAreaChanged )
+		{
+			// damage outside the previous area never made it into the snapshots
+			// so everything the new area adds has to be refreshed
+			const Types::Rectangle fullArea{ 0, 0, state.framebufferSize.width() - 1, state.framebufferSize.height() - 1 };
+			exposedArea = subtractedArea( m_captureArea.isValid() ? m_captureArea : fullArea,
+										  state.captureArea.isValid() ? state.captureArea : fullArea );
+
+			state.captureArea = m_captureArea;
+			m_captureAreaChanged = false;
+			m_framebuffer->setCaptureArea( state.captureArea );
+		}
+	}
+
+	state.lastCapture = FrameRateGovernor::Clock::now();
+
+	Framebuffer::Update update;
+	update.captureTime = state.lastCapture;
+	update.flags = m_framebuffer->update( &update.damage, &update.moves );
+
+	// polled framebuffers only change within update() so the detector's copy of
+	// the previous capture matches the content clients will apply the moves to
+	if( m_scrollDetectionEnabled && m_framebuffer->damageEvent() == Types::InvalidEventHandle )
+	{
+		m_scrollDetector.detect( m_framebuffer->data(), m_framebuffer->size(), m_framebuffer->bytesPerLine(),
+								 m_framebuffer->pixelFormat().bytesPerPixel(), &update.damage, &update.moves );
+	}
+
+	update.damage.add( exposedArea );
+
+	// drop damage on screens nobody is watching
+	if( state.captureArea.isValid() )
+	{
+		clipUpdate( &update, state.captureArea );
+	}
+
+	const auto captureTime = std::chrono::duration_cast<FrameRateGovernor::Duration>(
+								 FrameRateGovernor::Clock::now() - state.lastCapture );
+	m_governor.reportCapture( captureTime, update.damage.area() );
+	m_instrumentation.record( Instrumentation::Stage::Capture, captureTime );
+
+	if( update.flags & UpdateFlag::SizeChanged )
+	{
+		state.framebufferSize = m_framebuffer->size();
+		state.pixelFormat = m_framebuffer->pixelFormat();
+	}
+	else if( m_framebuffer->size() != state.framebufferSize ||
+			 m_framebuffer->pixelFormat() != state.pixelFormat )
+	{
+		update.flags |= UpdateFlag::RequiresRestart;
+	}
+
+	if( update.flags & UpdateFlag::CursorShapeChanged )
+	{
+		update.cursorShape = m_framebuffer->cursorShape();
+	}
+
+	if( update.flags & UpdateFlag::CursorMoved )
+	{
+		update.cursorPosition = m_framebuffer->cursorPosition();
+	}
+
+	auto currentScreens = m_framebuffer->availableScreens();
+	if( currentScreens != state.screens )
+	{
+		state.screens = currentScreens;
+		update.flags |= UpdateFlag::ScreenLayoutChanged;
+		update.screens = std::move(currentScreens);
+	}
+
+	mergeUpdate( &state.pendingUpdate, std::move(update) );
+}
+
+
+
+bool Server::queuePendingUpdate()
+{
+	auto& pendingUpdate = m_captureState.pendingUpdate;
+
+	if( hasContent( pendingUpdate ) &&
+		( m_updatesRequested || pendingUpdate.flags & Framebuffer::UpdateFlag::RequiresRestart ) )
+	{
+		const bool requiresRestart( pendingUpdate.flags & Framebuffer::UpdateFlag::RequiresRestart );
+
+		// the framebuffer is about to be recreated so there is nothing worth copying
+		if( requiresRestart == false )
+		{
+			auto changedRegion = pendingUpdate.damage;
+			for( const auto& move : pendingUpdate.moves )
+			{
+				changedRegion.add( move.destination() );
+			}
+
+			pendingUpdate.snapshot = takeSnapshot( changedRegion );
+			if( pendingUpdate.snapshot == nullptr )
+			{
+				return false;
+			}
+		}
+
+		// blocks while the network stage is busy with previous updates
+		if( m_updateQueue.push( std::move(pendingUpdate) ) == false )
+		{
+			return false;
+		}
+
+		pendingUpdate = {};
+		m_updateAvailable.signal();
+	}
+
+	return true;
+}
+
+
+
+SnapshotBuffers::Snapshot Server::takeSnapshot( const Types::Region& changedRegion )
+{
+	// blocks while the network stage still serves clients from all other buffers
+	return m_snapshotBuffers.take( m_framebuffer->data(), m_framebuffer->size(), m_framebuffer->bytesPerLine(),
+								   m_framebuffer->pixelFormat().bytesPerPixel(), changedRegion );
+}
+
+
+
+bool Server::hasContent( const Framebuffer::Update& update )
+{
+	using UpdateFlag = Framebuffer::UpdateFlag;
+
+	return update.damage.isEmpty() == false ||
+			update.moves.empty() == false ||
+			update.flags & ( UpdateFlag::SizeChanged | UpdateFlag::RequiresRestart | UpdateFlag::ScreenLayoutChanged |
+							 UpdateFlag::CursorShapeChanged | UpdateFlag::CursorMoved );
+}
+
+
+
+void Server::clipUpdate( Framebuffer::Update* update, const Types::Rectangle& area )
+{
+	// moves not entirely inside the area turn into damage of their destination
+	Types::Region damage;
+	Types::Moves moves;
+
+	for( const auto& move : update->moves )
+	{
+		if( move.destination().intersected( area ) == move.destination() &&
+			move.source().intersected( area ) == move.source() )
+		{
+			Types::appendMove( move, &damage, &moves );
+		}
+		else
+		{
+			damage.add( move.destination() );
+		}
+	}
+
+	damage.add( update->damage );
+
+	update->damage = damage.intersected( area );
+	update->moves = std::move(moves);
+}
+
+
+
+Types::Region Server::subtractedArea( const Types::Rectangle& area, const Types::Rectangle& subtrahend )
+{
+	Types::Region region;
+
+	const auto kept = area.intersected( subtrahend );
+	if( kept.isEmpty() )
+	{
+		region.add( area );
+		return region;
+	}
+
+	// stripes above and below the kept part plus the ones left and right of it
+	region.add( { area.left(), area.top(), area.right(), kept.top() - 1 } );
+	region.add( { area.left(), kept.bottom() + 1, area.right(), area.bottom() } );
+	region.add( { area.left(), kept.top(), kept.left() - 1, kept.bottom() } );
+	region.add( { kept.right() + 1, kept.top(), area.right(), kept.bottom() } );
+
+	return region;
+}
+
+
+
+void Server::mergeUpdate( Framebuffer::Update* pendingUpdate, Framebuffer::Update&& update )
+{
+	// keep the time of the oldest damage
+	if( hasContent( *pendingUpdate ) == false )
+	{
+		pendingUpdate->captureTime = update.captureTime;
+	}
+
+	pendingUpdate->flags |= update.flags;
+
+	if( update.flags & Framebuffer::UpdateFlag::ScreenLayoutChanged )
+	{
+		pendingUpdate->screens = std::move(update.screens);
+	}
+
+	if( update.flags & Framebuffer::UpdateFlag::CursorShapeChanged )
+	{
+		pendingUpdate->cursorShape = std::move(update.cursorShape);
+	}
+
+	if( update.flags & Framebuffer::UpdateFlag::CursorMoved )
+	{
+		pendingUpdate->cursorPosition = update.cursorPosition;
+	}
+
+	auto& damage = pendingUpdate->damage;
+
+	for( const auto& move : update.moves )
+	{
+		if( pendingUpdate->moves.size() < MaxPendingMoves )
+		{
+			Types::appendMove( move, &damage, &pendingUpdate->moves );
+		}
+		else
+		{
+			damage.add( move.destination() );
+		}
+	}
+
+	damage.add( update.damage );
+
+	// overlapping and adjacent damage is coalesced already, if it is still
+	// too fragmented a single update of the bounding rectangle is cheaper
+	if( damage.rectangleCount() > MaxPendingRectangles )
+	{
+		damage = damage.boundingRect();
+	}
+}
+
+
+
+bool Server::processCapturedUpdates()
+{
+	Framebuffer::Update update;
+
+	while( m_updateQueue.tryPop( update ) )
+	{
+		if( update.flags & Framebuffer::UpdateFlag::RequiresRestart )
+		{
+			return false;
+		}
+
+		const auto pixels = update.damage.area();
+		m_unsentPixels += pixels;
+		m_instrumentation.add( Instrumentation::Counter::Rectangles, update.damage.rectangleCount() );
+		m_instrumentation.add( Instrumentation::Counter::Pixels, pixels );
+		m_instrumentation.record( Instrumentation::Stage::UpdateQueueing,
+								  std::chrono::duration_cast<Instrumentation::Duration>(
+									  Instrumentation::Clock::now() - update.captureTime ) );
+
+		// the previous snapshot must not be reused before the backend switched over
+		const auto previousSnapshot = std::move(m_snapshot);
+		m_snapshot = std::move(update.snapshot);
+
+		Instrumentation::Timer timer( m_instrumentation, Instrumentation::Stage::DamageMarking );
+		m_backend->handleFramebufferUpdate( update );
+	}
+
+	return true;
+}
+
+
+
+bool Server::createPlugins()
+{
+	return createFramebuffer() &&
+			createKeyboard() &&
+			createPointingDevice() &&
+			createClipboard() &&
+			createEncoders() &&
+			createBackend();
+}
+
+
+
 bool Server::createFramebuffer()
 {
-	m_framebuffer = PluginLoader().createAndInitialize<Framebuffer>( this );
+	if( m_externalFramebuffer )
+	{
+		m_framebuffer = m_externalFramebuffer->initialize( this ) ? m_externalFramebuffer : nullptr;
+	}
+	else
+	{
+		m_framebuffer = PluginLoader().createAndInitialize<Framebuffer>( this, m_framebufferPlugin );
+	}
+
+	if( m_framebuffer == nullptr )
+	{
+		return false;
+	}
+
+	// initial contents for the backend until the first captured update arrives
+	const auto size = m_framebuffer->size();
+	m_snapshot = takeSnapshot( Types::Rectangle( 0, 0, size.width() - 1, size.height() - 1 ) );
+
+	return m_snapshot != nullptr;
+}
+
+
+
+void Server::destroyFramebuffer()
+{
+	if( m_framebuffer != m_externalFramebuffer )
+	{
+		delete m_framebuffer;
+	}
 
-	return m_framebuffer != nullptr;
+	m_framebuffer = nullptr;
 }
 
 
@@ -109,6 +790,16 @@ bool Server::createKeyboard()
 
 
 
+bool Server::createEncoders()
+{
+	// encoders are optional - clients are served with the backend's built-in encodings otherwise
+	m_encoders = PluginLoader().createAllAndInitialize<Interfaces::Encoder>( this );
+
+	return true;
+}
+
+
+
 bool Server::createBackend()
 {
 	m_backend = PluginLoader().createAndInitialize<Backend>( this );
@@ -120,6 +811,8 @@ bool Server::createBackend()
 
 void Server::shutdown()
 {
+	stopCapturing();
+
 	if( m_backend )
 	{
 		m_backend->shutdown();
@@ -128,6 +821,14 @@ void Server::shutdown()
 	delete m_backend;
 	m_backend = nullptr;
 
+	for( auto encoder : m_encoders )
+	{
+		delete encoder;
+	}
+	m_encoders.clear();
+
+	m_snapshot = {};
+
 	delete m_clipboard;
 	m_clipboard = nullptr;
 
@@ -137,8 +838,7 @@ void Server::shutdown()
 	delete m_keyboard;
 	m_keyboard = nullptr;
 
-	delete m_framebuffer;
-	m_framebuffer = nullptr;
+	destroyFramebuffer();
 
 }
 
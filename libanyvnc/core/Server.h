@@ -22,10 +22,22 @@
  *
  */
 
+#pragma once
+
+#include <array>
 #include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/core/BoundedQueue.h"
+#include "libanyvnc/core/Event.h"
+#include "libanyvnc/core/FrameRateGovernor.h"
+#include "libanyvnc/core/Instrumentation.h"
+#include "libanyvnc/core/ScrollDetector.h"
+#include "libanyvnc/core/SnapshotBuffers.h"
 #include "libanyvnc/interfaces/Clipboard.h"
+#include "libanyvnc/interfaces/Encoder.h"
 #include "libanyvnc/interfaces/Framebuffer.h"
 #include "libanyvnc/interfaces/Keyboard.h"
 #include "libanyvnc/interfaces/PointingDevice.h"
@@ -37,15 +49,29 @@ namespace AnyVnc
 namespace Core
 {
 
+class SessionHost;
+
 class ANYVNC_CORE_EXPORT Server
 {
+	friend class SessionHost;
 public:
 	using Clipboard = Interfaces::Clipboard;
+	using Encoders = Interfaces::Encoders;
 	using Framebuffer = Interfaces::Framebuffer;
 	using Keyboard = Interfaces::Keyboard;
 	using PointingDevice = Interfaces::PointingDevice;
 	using Backend = Interfaces::ServerBackend;
 
+	struct PipelineStatistics
+	{
+		size_t captureQueueDepth{0};
+		size_t captureQueueMaxDepth{0};
+		uint64_t capturedUpdates{0};
+		uint64_t captureStalls{0};
+		size_t pendingClientUpdates{0};
+		int frameRate{0};
+	};
+
 	Server() = default;
 	virtual ~Server() = default;
 
@@ -69,6 +95,82 @@ public:
 		m_password = password;
 	}
 
+	int maximumFrameRate() const
+	{
+		return m_governor.maximumFrameRate();
+	}
+
+	void setMaximumFrameRate( int maximumFrameRate )
+	{
+		m_governor.setMaximumFrameRate( maximumFrameRate );
+	}
+
+	// percentage of one CPU core to spend on capturing and encoding
+	int cpuBudget() const
+	{
+		return m_governor.cpuBudget();
+	}
+
+	void setCpuBudget( int cpuBudget )
+	{
+		m_governor.setCpuBudget( cpuBudget );
+	}
+
+	// serve each screen additionally on port()+1+index
+	bool screenPortsEnabled() const
+	{
+		return m_screenPortsEnabled;
+	}
+
+	void setScreenPortsEnabled( bool enabled )
+	{
+		m_screenPortsEnabled = enabled;
+	}
+
+	// serve the framebuffer downscaled by each of ScaledMirrorScales on
+	// scaledMirrorPort() and the following ports for thumbnail viewers - 0
+	// disables the mirrors
+	static constexpr std::array<int, 3> ScaledMirrorScales{ { 2, 4, 8 } };
+
+	int scaledMirrorPort() const
+	{
+		return m_scaledMirrorPort;
+	}
+
+	void setScaledMirrorPort( int port )
+	{
+		m_scaledMirrorPort = port;
+	}
+
+	// detect scrolled content of polled framebuffers and send it as CopyRect
+	bool scrollDetectionEnabled() const
+	{
+		return m_scrollDetectionEnabled;
+	}
+
+	void setScrollDetectionEnabled( bool enabled )
+	{
+		m_scrollDetectionEnabled = enabled;
+	}
+
+	// serve the given framebuffer (e.g. a Canvas) instead of loading a plugin -
+	// it is not deleted by the server
+	void setFramebuffer( Framebuffer* framebuffer )
+	{
+		m_externalFramebuffer = framebuffer;
+	}
+
+	// uid or name of the framebuffer plugin to use instead of the default one
+	std::string framebufferPlugin() const
+	{
+		return m_framebufferPlugin;
+	}
+
+	void setFramebufferPlugin( const std::string& framebufferPlugin )
+	{
+		m_framebufferPlugin = framebufferPlugin;
+	}
+
 	Clipboard* clipboard() const
 	{
 		return m_clipboard;
@@ -79,6 +181,19 @@ public:
 		return m_framebuffer;
 	}
 
+	// copy of the framebuffer clients are currently served from - only
+	// changes while processing captured updates in the network thread
+	const Types::Image* snapshot() const
+	{
+		return m_snapshot.get();
+	}
+
+	// additional encodings offered to clients by backends supporting them
+	const Encoders& encoders() const
+	{
+		return m_encoders;
+	}
+
 	Keyboard* keyboard() const
 	{
 		return m_keyboard;
@@ -89,32 +204,123 @@ public:
 		return m_pointingDevice;
 	}
 
+	// returns once quit() has been called - false if the plugins couldn't be
+	// created or the framebuffer couldn't be restarted
 	bool run();
 	void quit();
 
+	// to be called by backends after injecting keyboard or pointer input -
+	// triggers an immediate capture and captures at the maximum frame rate for a while
+	void notifyInputInjected()
+	{
+		m_inputInjected = true;
+		m_captureWakeup.signal();
+	}
+
+	PipelineStatistics pipelineStatistics() const;
+
+	Instrumentation& instrumentation()
+	{
+		return m_instrumentation;
+	}
+
 private:
 	static constexpr auto IdleTimeout = 100;
-	static constexpr auto NonIdleTimeout = 5;
+	static constexpr auto CaptureQueueCapacity = 4;
+	static constexpr auto MaxPendingRectangles = 256;
+	static constexpr auto MaxPendingMoves = 64;
+	static constexpr auto InputBoostDuration = std::chrono::milliseconds(250);
 
+	struct CaptureState
+	{
+		Types::Size framebufferSize;
+		Types::PixelFormat pixelFormat{Types::PixelFormat::xrgb8888()};
+		Types::Screens screens;
+		Types::Rectangle captureArea;
+		// damage collected while no client is able to receive an update
+		Framebuffer::Update pendingUpdate;
+		FrameRateGovernor::Clock::time_point lastCapture;
+		FrameRateGovernor::Clock::time_point inputBoostEnd;
+	};
+
+	// steps for running as one of many sessions of a SessionHost
+	bool startSession();
+	void collectEventHandles( std::vector<Types::EventHandle>* handles, int* timeout ) const;
+	bool serviceSession();
+
+	bool createPlugins();
 	bool createFramebuffer();
+	void destroyFramebuffer();
 	bool createKeyboard();
 	bool createPointingDevice();
 	bool createClipboard();
+	bool createEncoders();
 	bool createBackend();
 
+	void startCapturing();
+	void stopCapturing();
+	void captureLoop();
+	int captureDelay() const;
+	bool handleInputInjection();
+	void capture();
+	bool queuePendingUpdate();
+	SnapshotBuffers::Snapshot takeSnapshot( const Types::Region& changedRegion );
+	static bool hasContent( const Framebuffer::Update& update );
+	static void clipUpdate( Framebuffer::Update* update, const Types::Rectangle& area );
+	static Types::Region subtractedArea( const Types::Rectangle& area, const Types::Rectangle& subtrahend );
+	static void mergeUpdate( Framebuffer::Update* pendingUpdate, Framebuffer::Update&& update );
+	bool processCapturedUpdates();
+	bool restartFramebuffer();
+	bool updateCaptureArea();
+	void updateClientState();
+	void processNetworkEvents();
+
 	void shutdown();
 
 	int m_port{5900};
 	std::string m_password{};
+	bool m_screenPortsEnabled{false};
+	int m_scaledMirrorPort{0};
+	bool m_scrollDetectionEnabled{true};
+	std::string m_framebufferPlugin{};
+	Framebuffer* m_externalFramebuffer{nullptr};
 
 	std::atomic<bool> m_quit{false};
+	bool m_hosted{false};
 
 	Framebuffer* m_framebuffer{nullptr};
 	Keyboard* m_keyboard{nullptr};
 	PointingDevice* m_pointingDevice{nullptr};
 	Clipboard* m_clipboard{nullptr};
+	Encoders m_encoders;
 	Backend* m_backend{nullptr};
 
+	std::thread m_captureThread;
+	std::atomic<bool> m_captureRunning{false};
+	std::atomic<bool> m_clientsConnected{false};
+	std::atomic<bool> m_updatesRequested{false};
+	std::atomic<bool> m_inputInjected{false};
+	Event m_captureWakeup;
+	Event m_updateAvailable;
+	SnapshotBuffers m_snapshotBuffers;
+	BoundedQueue<Framebuffer::Update> m_updateQueue{CaptureQueueCapacity};
+	SnapshotBuffers::Snapshot m_snapshot;
+	std::atomic<size_t> m_pendingClientUpdates{0};
+	uint64_t m_unsentPixels{0};
+	FrameRateGovernor::Duration m_encodeTime{};
+	FrameRateGovernor::Clock::time_point m_lastUpdateSent;
+
+	CaptureState m_captureState;
+	ScrollDetector m_scrollDetector;
+	bool m_damagePending{false};
+
+	FrameRateGovernor m_governor;
+	Instrumentation m_instrumentation;
+
+	std::mutex m_captureAreaMutex;
+	Types::Rectangle m_captureArea;
+	bool m_captureAreaChanged{false};
+
 };
 
 }
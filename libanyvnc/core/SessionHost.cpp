@@ -0,0 +1,205 @@
+/*
+ * core/SessionHost.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+
+#include "SessionHost.h"
+#include "Server.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+SessionHost::SessionHost( size_t workerCount ) :
+	m_workerPool( workerCount )
+{
+}
+
+
+
+void SessionHost::addSession( Server* server )
+{
+	// counted first so that run() never sees a pending session as missing
+	++m_sessionCount;
+
+	{
+		std::lock_guard<std::mutex> lock( m_pendingSessionsMutex );
+		m_pendingSessions.push_back( server );
+	}
+
+	m_wakeup.signal();
+}
+
+
+
+bool SessionHost::run()
+{
+	m_quit = false;
+
+	std::vector<Types::EventHandle> handles;
+	std::vector<bool> signaled;
+	bool sessionsStarted = false;
+
+	while( m_quit == false )
+	{
+		sessionsStarted |= startPendingSessions();
+
+		handles.clear();
+		handles.push_back( m_wakeup.handle() );
+
+		auto timeout = IdleTimeout;
+		const auto now = Clock::now();
+
+		for( auto it = m_sessions.begin(); it != m_sessions.end(); )
+		{
+			auto& session = *it;
+
+			// handles of busy sessions are left out to not wake up over and over
+			if( session->busy )
+			{
+				session->handleCount = 0;
+				session->deadline = Clock::time_point::max();
+				++it;
+				continue;
+			}
+
+			if( session->server->m_quit )
+			{
+				session->server->shutdown();
+				it = m_sessions.erase( it );
+				--m_sessionCount;
+				continue;
+			}
+
+			auto sessionTimeout = IdleTimeout;
+			session->firstHandle = handles.size();
+			session->server->collectEventHandles( &handles, &sessionTimeout );
+			session->handleCount = handles.size() - session->firstHandle;
+			session->deadline = now + std::chrono::milliseconds( sessionTimeout );
+
+			timeout = std::min( timeout, sessionTimeout );
+			++it;
+		}
+
+		// all sessions quit or failed to start and none are waiting to be started
+		if( m_sessions.empty() && m_sessionCount == 0 )
+		{
+			break;
+		}
+
+		Event::waitForMultiple( handles, timeout, &signaled );
+		m_wakeup.reset();
+
+		const auto wakeTime = Clock::now();
+
+		for( const auto& session : m_sessions )
+		{
+			if( session->busy )
+			{
+				continue;
+			}
+
+			bool active = wakeTime >= session->deadline;
+			for( size_t i = 0; i < session->handleCount && active == false; ++i )
+			{
+				active = signaled[session->firstHandle + i];
+			}
+
+			if( active )
+			{
+				session->busy = true;
+				m_workerPool.submit( [this, session = session.get()]() { serviceSession( session ); } );
+			}
+		}
+	}
+
+	m_workerPool.waitForDone();
+
+	for( const auto& session : m_sessions )
+	{
+		session->server->shutdown();
+	}
+
+	m_sessions.clear();
+	m_sessionCount = 0;
+
+	return sessionsStarted;
+}
+
+
+
+void SessionHost::quit()
+{
+	m_quit = true;
+	m_wakeup.signal();
+}
+
+
+
+bool SessionHost::startPendingSessions()
+{
+	bool started = false;
+
+	std::vector<Server *> pendingSessions;
+
+	{
+		std::lock_guard<std::mutex> lock( m_pendingSessionsMutex );
+		pendingSessions.swap( m_pendingSessions );
+	}
+
+	for( auto server : pendingSessions )
+	{
+		if( server->startSession() == false )
+		{
+			--m_sessionCount;
+			continue;
+		}
+
+		auto session = std::make_unique<Session>();
+		session->server = server;
+		m_sessions.push_back( std::move(session) );
+		started = true;
+	}
+
+	return started;
+}
+
+
+
+void SessionHost::serviceSession( Session* session )
+{
+	if( session->server->serviceSession() == false )
+	{
+		session->server->quit();
+	}
+
+	session->busy = false;
+	m_wakeup.signal();
+}
+
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * core/SessionHost.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "libanyvnc/core/Event.h"
+#include "libanyvnc/core/FrameRateGovernor.h"
+#include "libanyvnc/core/WorkerPool.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+class Server;
+
+// runs many Server sessions in one process - a single event loop waits for
+// the sockets and damage events of all sessions and services active sessions
+// on a shared worker pool which captures and encodes
+class ANYVNC_CORE_EXPORT SessionHost
+{
+public:
+	// zero workers selects the number of available cores
+	explicit SessionHost( size_t workerCount = 0 );
+	~SessionHost() = default;
+
+	SessionHost( const SessionHost& ) = delete;
+	SessionHost& operator=( const SessionHost& ) = delete;
+
+	size_t workerCount() const
+	{
+		return m_workerPool.threadCount();
+	}
+
+	size_t sessionCount() const
+	{
+		return m_sessionCount;
+	}
+
+	// sessions can be added before and while running, ownership stays with the caller
+	void addSession( Server* server );
+
+	// returns once quit() has been called or no session is left to serve -
+	// false if no session could be started at all
+	bool run();
+	void quit();
+
+private:
+	using Clock = FrameRateGovernor::Clock;
+
+	static constexpr auto IdleTimeout = 100;
+
+	struct Session
+	{
+		Server* server{nullptr};
+		std::atomic<bool> busy{false};
+		Clock::time_point deadline{};
+		size_t firstHandle{0};
+		size_t handleCount{0};
+	};
+
+	bool startPendingSessions();
+	void serviceSession( Session* session );
+
+	WorkerPool m_workerPool;
+	Event m_wakeup;
+	std::atomic<bool> m_quit{false};
+
+	std::mutex m_pendingSessionsMutex;
+	std::vector<Server *> m_pendingSessions;
+	std::vector<std::unique_ptr<Session>> m_sessions;
+	std::atomic<size_t> m_sessionCount{0};
+
+};
+
+}
+
+}
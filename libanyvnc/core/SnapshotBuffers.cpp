@@ -0,0 +1,179 @@
+/*
+ * SnapshotBuffers.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "SnapshotBuffers.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+SnapshotBuffers::SnapshotBuffers( size_t bufferCount ) :
+	m_buffers( std::max<size_t>( bufferCount, 1 ) )
+{
+}
+
+
+
+SnapshotBuffers::~SnapshotBuffers() = default;
+
+
+
+SnapshotBuffers::Snapshot SnapshotBuffers::take( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+												 const Types::Region& damage )
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	auto buffer = acquire( lock );
+	if( buffer == nullptr )
+	{
+		return {};
+	}
+
+	// all other buffers miss this damage from now on
+	for( auto& other : m_buffers )
+	{
+		if( &other != buffer )
+		{
+			other.staleRegion.add( damage );
+			if( other.staleRegion.rectangleCount() > MaxStaleRectangles )
+			{
+				other.staleRegion = other.staleRegion.boundingRect();
+			}
+		}
+	}
+
+	auto region = std::move(buffer->staleRegion);
+	buffer->staleRegion.clear();
+
+	const Types::Rectangle bounds{ 0, 0, size.width() - 1, size.height() - 1 };
+
+	if( buffer->image == nullptr ||
+		buffer->image->size() != size ||
+		buffer->image->bytesPerLine() != bytesPerLine )
+	{
+		buffer->image = std::make_unique<Types::Image>( size, bytesPerLine );
+		region = bounds;
+	}
+	else
+	{
+		region.add( damage );
+		region = region.intersected( bounds );
+	}
+
+	// the buffer is exclusively ours until it is released again
+	lock.unlock();
+
+	copy( data, buffer->image.get(), bytesPerPixel, region );
+
+	return Snapshot( buffer->image.get(), [this, buffer]( const Types::Image* ) { release( buffer ); } );
+}
+
+
+
+void SnapshotBuffers::open()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_closed = false;
+}
+
+
+
+void SnapshotBuffers::close()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	m_closed = true;
+	lock.unlock();
+
+	m_released.notify_all();
+}
+
+
+
+SnapshotBuffers::Buffer* SnapshotBuffers::acquire( std::unique_lock<std::mutex>& lock )
+{
+	Buffer* buffer = nullptr;
+
+	const auto findFreeBuffer = [this, &buffer]() {
+		for( auto& candidate : m_buffers )
+		{
+			if( candidate.inUse == false )
+			{
+				buffer = &candidate;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	if( findFreeBuffer() == false && m_closed == false )
+	{
+		m_released.wait( lock, [this, &findFreeBuffer]() { return findFreeBuffer() || m_closed; } );
+	}
+
+	if( buffer )
+	{
+		buffer->inUse = true;
+	}
+
+	return buffer;
+}
+
+
+
+void SnapshotBuffers::release( Buffer* buffer )
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	buffer->inUse = false;
+	lock.unlock();
+
+	m_released.notify_one();
+}
+
+
+
+void SnapshotBuffers::copy( const void* data, Types::Image* image, int bytesPerPixel, const Types::Region& region )
+{
+	const auto source = reinterpret_cast<const uint8_t *>( data );
+	const auto bytesPerLine = size_t(image->bytesPerLine());
+
+	for( const auto& rect : region.rectangles() )
+	{
+		const auto offset = size_t(rect.left()) * size_t(bytesPerPixel);
+		const auto length = size_t(rect.width()) * size_t(bytesPerPixel);
+
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			memcpy( image->scanLine( y ) + offset, source + size_t(y) * bytesPerLine + offset, length );
+		}
+	}
+}
+
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * SnapshotBuffers.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/Image.h"
+#include "libanyvnc/types/Region.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// rotates a few copies of the framebuffer so that clients are served from a
+// stable snapshot while the capture stage already writes the next frame -
+// a buffer only receives the regions which changed since it was used last
+class ANYVNC_CORE_EXPORT SnapshotBuffers
+{
+public:
+	using Snapshot = std::shared_ptr<const Types::Image>;
+
+	static constexpr auto DefaultBufferCount = 3;
+
+	explicit SnapshotBuffers( size_t bufferCount = DefaultBufferCount );
+	~SnapshotBuffers();
+
+	// copies damage from data into a free buffer - blocks while all buffers are
+	// still referenced and returns null if close() is called meanwhile
+	Snapshot take( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+				   const Types::Region& damage );
+
+	void open();
+	void close();
+
+private:
+	static constexpr auto MaxStaleRectangles = 256;
+
+	struct Buffer
+	{
+		std::unique_ptr<Types::Image> image;
+		// damage which happened while the buffer was not the current one
+		Types::Region staleRegion;
+		bool inUse{false};
+	};
+
+	Buffer* acquire( std::unique_lock<std::mutex>& lock );
+	void release( Buffer* buffer );
+
+	static void copy( const void* data, Types::Image* image, int bytesPerPixel, const Types::Region& region );
+
+	std::mutex m_mutex;
+	std::condition_variable m_released;
+	std::vector<Buffer> m_buffers;
+	bool m_closed{false};
+
+};
+
+}
+
+}
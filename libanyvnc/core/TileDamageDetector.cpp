@@ -0,0 +1,216 @@
+/*
+ * core/TileDamageDetector.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "TileDamageDetector.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// constants and rounds of XXH64
+static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t Prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+
+static inline uint64_t rotateLeft( uint64_t value, int bits )
+{
+	return ( value << bits ) | ( value >> ( 64 - bits ) );
+}
+
+
+static inline uint64_t mixRound( uint64_t accumulator, uint64_t input )
+{
+	return rotateLeft( accumulator + input * Prime2, 31 ) * Prime1;
+}
+
+
+static inline uint64_t readWord( const uint8_t* data )
+{
+	uint64_t word;
+	memcpy( &word, data, sizeof(word) );
+	return word;
+}
+
+
+
+TileDamageDetector::TileDamageDetector( int tileSize ) :
+	m_tileSize( std::max( tileSize, 1 ) )
+{
+}
+
+
+
+void TileDamageDetector::setTileSize( int tileSize )
+{
+	tileSize = std::max( tileSize, 1 );
+
+	if( tileSize != m_tileSize )
+	{
+		m_tileSize = tileSize;
+		reset();
+	}
+}
+
+
+
+void TileDamageDetector::reset()
+{
+	m_valid = false;
+}
+
+
+
+void TileDamageDetector::detect( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+								 Types::Region* damage, const Types::Region* dirtyHint )
+{
+	if( data == nullptr || size.width() <= 0 || size.height() <= 0 )
+	{
+		return;
+	}
+
+	if( size != m_size || bytesPerPixel != m_bytesPerPixel )
+	{
+		m_size = size;
+		m_bytesPerPixel = bytesPerPixel;
+		m_valid = false;
+	}
+
+	if( m_valid == false )
+	{
+		m_columns = ( size.width() + m_tileSize - 1 ) / m_tileSize;
+		m_rows = ( size.height() + m_tileSize - 1 ) / m_tileSize;
+		m_hashes.assign( size_t(m_columns * m_rows), 0 );
+		m_dirtyTiles.assign( m_hashes.size(), 1 );
+	}
+	else if( dirtyHint )
+	{
+		std::fill( m_dirtyTiles.begin(), m_dirtyTiles.end(), 0 );
+
+		for( const auto& rect : dirtyHint->rectangles() )
+		{
+			const auto firstColumn = std::max( rect.left() / m_tileSize, 0 );
+			const auto lastColumn = std::min( rect.right() / m_tileSize, m_columns - 1 );
+			const auto firstRow = std::max( rect.top() / m_tileSize, 0 );
+			const auto lastRow = std::min( rect.bottom() / m_tileSize, m_rows - 1 );
+
+			for( int row = firstRow; row <= lastRow; ++row )
+			{
+				std::fill_n( m_dirtyTiles.begin() + row * m_columns + firstColumn,
+							 std::max( lastColumn - firstColumn + 1, 0 ), 1 );
+			}
+		}
+	}
+	else
+	{
+		std::fill( m_dirtyTiles.begin(), m_dirtyTiles.end(), 1 );
+	}
+
+	const auto bytes = reinterpret_cast<const uint8_t *>( data );
+
+	for( int row = 0; row < m_rows; ++row )
+	{
+		const auto top = row * m_tileSize;
+		const auto tileHeight = std::min( m_tileSize, size.height() - top );
+
+		for( int column = 0; column < m_columns; ++column )
+		{
+			const auto index = size_t(row * m_columns + column);
+			if( m_dirtyTiles[index] == 0 )
+			{
+				continue;
+			}
+
+			const auto left = column * m_tileSize;
+			const auto tileWidth = std::min( m_tileSize, size.width() - left );
+
+			const auto hash = hashTile( bytes + top * bytesPerLine + left * bytesPerPixel, bytesPerLine,
+										size_t(tileWidth * bytesPerPixel), tileHeight );
+
+			if( hash != m_hashes[index] || m_valid == false )
+			{
+				m_hashes[index] = hash;
+				damage->add( { left, top, left + tileWidth - 1, top + tileHeight - 1 } );
+			}
+		}
+	}
+
+	m_valid = true;
+}
+
+
+
+uint64_t TileDamageDetector::hashTile( const uint8_t* data, int bytesPerLine, size_t rowLength, int rowCount )
+{
+	// four independent lanes keep the multipliers busy like in XXH64
+	uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+	uint64_t tail = Prime5;
+
+	for( int y = 0; y < rowCount; ++y )
+	{
+		const auto row = data + y * bytesPerLine;
+
+		size_t offset = 0;
+		for( ; offset + 32 <= rowLength; offset += 32 )
+		{
+			lanes[0] = mixRound( lanes[0], readWord( row + offset ) );
+			lanes[1] = mixRound( lanes[1], readWord( row + offset + 8 ) );
+			lanes[2] = mixRound( lanes[2], readWord( row + offset + 16 ) );
+			lanes[3] = mixRound( lanes[3], readWord( row + offset + 24 ) );
+		}
+
+		for( ; offset + 8 <= rowLength; offset += 8 )
+		{
+			tail = rotateLeft( tail ^ mixRound( 0, readWord( row + offset ) ), 27 ) * Prime1 + Prime4;
+		}
+
+		for( ; offset < rowLength; ++offset )
+		{
+			tail = rotateLeft( tail ^ ( row[offset] * Prime5 ), 11 ) * Prime1;
+		}
+	}
+
+	auto hash = rotateLeft( lanes[0], 1 ) + rotateLeft( lanes[1], 7 ) +
+				rotateLeft( lanes[2], 12 ) + rotateLeft( lanes[3], 18 ) + tail;
+
+	// avalanche
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * core/TileDamageDetector.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+#include "libanyvnc/types/Region.h"
+#include "libanyvnc/types/Size.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// determines damage for framebuffers without change notifications by
+// comparing a hash per tile against the one of the previous frame
+class ANYVNC_CORE_EXPORT TileDamageDetector
+{
+public:
+	static constexpr auto DefaultTileSize = 64;
+
+	explicit TileDamageDetector( int tileSize = DefaultTileSize );
+
+	int tileSize() const
+	{
+		return m_tileSize;
+	}
+
+	void setTileSize( int tileSize );
+
+	// makes the next call of detect() report the whole framebuffer
+	void reset();
+
+	// adds all changed tiles to damage - if dirtyHint is given (e.g. the rows
+	// a capture source reported dirty), only tiles intersecting it are rechecked
+	void detect( const void* data, Types::Size size, int bytesPerLine, int bytesPerPixel,
+				 Types::Region* damage, const Types::Region* dirtyHint = nullptr );
+
+private:
+	static uint64_t hashTile( const uint8_t* data, int bytesPerLine, size_t rowLength, int rowCount );
+
+	int m_tileSize;
+
+	Types::Size m_size{};
+	int m_bytesPerPixel{0};
+	int m_columns{0};
+	int m_rows{0};
+	bool m_valid{false};
+
+	std::vector<uint64_t> m_hashes;
+	std::vector<uint8_t> m_dirtyTiles;
+
+};
+
+}
+
+}
@@ -0,0 +1,171 @@
+/*
+ * core/WorkerPool.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "WorkerPool.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+WorkerPool::WorkerPool( size_t threadCount )
+{
+	if( threadCount == 0 )
+	{
+		threadCount = std::max<size_t>( std::thread::hardware_concurrency(), 1 );
+	}
+
+	m_threads.reserve( threadCount );
+
+	for( size_t i = 0; i < threadCount; ++i )
+	{
+		m_threads.emplace_back( [this]() { run(); } );
+	}
+}
+
+
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_stopping = true;
+	}
+
+	m_taskAvailable.notify_all();
+
+	for( auto& thread : m_threads )
+	{
+		thread.join();
+	}
+}
+
+
+
+void WorkerPool::submit( Task&& task )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_tasks.push_back( std::move(task) );
+	}
+
+	m_taskAvailable.notify_one();
+}
+
+
+
+void WorkerPool::waitForDone()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	m_done.wait( lock, [this]() { return m_tasks.empty() && m_activeTasks == 0; } );
+}
+
+
+
+void WorkerPool::runParallel( size_t count, const std::function<void(size_t)>& function )
+{
+	// shared with the submitted tasks which may only start after all indices have been processed
+	struct Batch
+	{
+		const std::function<void(size_t)>& function;
+		const size_t count;
+		std::atomic<size_t> nextIndex{0};
+		size_t finishedCount{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	std::shared_ptr<Batch> batch( new Batch{ function, count } );
+
+	const auto processIndices = [batch]() {
+		size_t processed = 0;
+		for( auto i = batch->nextIndex++; i < batch->count; i = batch->nextIndex++ )
+		{
+			batch->function( i );
+			++processed;
+		}
+
+		if( processed > 0 )
+		{
+			std::lock_guard<std::mutex> lock( batch->mutex );
+			batch->finishedCount += processed;
+			if( batch->finishedCount == batch->count )
+			{
+				batch->finished.notify_all();
+			}
+		}
+	};
+
+	const auto helperCount = std::min( threadCount(), std::max<size_t>( count, 1 ) - 1 );
+	for( size_t i = 0; i < helperCount; ++i )
+	{
+		submit( processIndices );
+	}
+
+	processIndices();
+
+	std::unique_lock<std::mutex> lock( batch->mutex );
+	batch->finished.wait( lock, [&batch]() { return batch->finishedCount == batch->count; } );
+}
+
+
+
+void WorkerPool::run()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+
+	while( true )
+	{
+		m_taskAvailable.wait( lock, [this]() { return m_stopping || m_tasks.empty() == false; } );
+
+		if( m_tasks.empty() )
+		{
+			// stopping and no tasks left
+			break;
+		}
+
+		auto task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+		++m_activeTasks;
+
+		lock.unlock();
+		task();
+		lock.lock();
+
+		--m_activeTasks;
+		if( m_tasks.empty() && m_activeTasks == 0 )
+		{
+			m_done.notify_all();
+		}
+	}
+}
+
+}
+
+}
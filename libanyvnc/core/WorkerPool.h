@@ -0,0 +1,85 @@
+/*
+ * core/WorkerPool.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "libanyvnc/core/AnyVncCore.h"
+
+namespace AnyVnc
+{
+
+namespace Core
+{
+
+// fixed number of threads executing submitted tasks in FIFO order
+class ANYVNC_CORE_EXPORT WorkerPool
+{
+public:
+	using Task = std::function<void()>;
+
+	// zero threads selects the number of available cores
+	explicit WorkerPool( size_t threadCount = 0 );
+	~WorkerPool();
+
+	WorkerPool( const WorkerPool& ) = delete;
+	WorkerPool& operator=( const WorkerPool& ) = delete;
+
+	size_t threadCount() const
+	{
+		return m_threads.size();
+	}
+
+	void submit( Task&& task );
+
+	// blocks until the queue is empty and no task is running anymore
+	void waitForDone();
+
+	// calls function for every index below count on the pool's threads and the
+	// calling thread and returns once all calls are done - doesn't wait for
+	// other tasks, so it can be used from tasks of the same pool as well
+	void runParallel( size_t count, const std::function<void(size_t)>& function );
+
+private:
+	void run();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_taskAvailable;
+	std::condition_variable m_done;
+	std::deque<Task> m_tasks;
+	size_t m_activeTasks{0};
+	bool m_stopping{false};
+
+};
+
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ * interfaces/Encoder.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "libanyvnc/types/Image.h"
+#include "libanyvnc/types/PixelFormat.h"
+#include "libanyvnc/types/Rectangle.h"
+#include "libanyvnc/types/Size.h"
+
+#include "ServerPlugin.h"
+
+namespace AnyVnc
+{
+
+namespace Interfaces
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+class ANYVNC_INTERFACES_EXPORT Encoder : public ServerPlugin
+{
+public:
+	// data kept per client in between updates, e.g. compression streams
+	class ANYVNC_INTERFACES_EXPORT ClientState
+	{
+	public:
+		virtual ~ClientState();
+	};
+
+	// pixel layout requested by the client via SetPixelFormat
+	struct TargetFormat
+	{
+		Types::PixelFormat pixelFormat{Types::PixelFormat::xrgb8888()};
+		bool bigEndian{false};
+	};
+
+	~Encoder() override;
+
+	// RFB encoding number which clients announce via SetEncodings
+	virtual int32_t encoding() const = 0;
+
+	virtual std::unique_ptr<ClientState> createClientState() const
+	{
+		return {};
+	}
+
+	// encoders returning a valid size encode rectangles of up to this size
+	// independently of each other and without touching the client state -
+	// large updates are then split into such tiles and encoded concurrently
+	virtual Types::Size tileSize() const
+	{
+		return {};
+	}
+
+	// appends everything following the header of rect to output - rect refers
+	// to image whose pixels are laid out in sourceFormat - returning false
+	// makes the backend fall back to its built-in encodings for the client
+	virtual bool encode( const Types::Image& image, const Types::PixelFormat& sourceFormat,
+						 const Types::Rectangle& rect, const TargetFormat& targetFormat,
+						 ClientState* clientState, std::vector<uint8_t>* output ) = 0;
+
+};
+
+using Encoders = std::vector<Encoder *>;
+
+}
+
+}
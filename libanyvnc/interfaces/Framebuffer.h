@@ -24,10 +24,17 @@
 
 #pragma once
 
-#include <functional>
+#include <chrono>
+#include <memory>
 #include <vector>
 
+#include "libanyvnc/types/Cursor.h"
+#include "libanyvnc/types/EventHandle.h"
+#include "libanyvnc/types/Image.h"
+#include "libanyvnc/types/Move.h"
+#include "libanyvnc/types/PixelFormat.h"
 #include "libanyvnc/types/Rectangle.h"
+#include "libanyvnc/types/Region.h"
 #include "libanyvnc/types/Size.h"
 #include "libanyvnc/types/Screen.h"
 
@@ -50,21 +57,76 @@ public:
 		Initializing = 0x0001,
 		SizeChanged = 0x0002,
 		RequiresRestart = 0x0004,
+		ScreenLayoutChanged = 0x0008,
+		CursorShapeChanged = 0x0010,
+		CursorMoved = 0x0020,
 		_
 	} ;
 	using UpdateFlags = flag_set<UpdateFlag>;
 
-	using RectangleVisitor = std::function<void(Types::Rectangle)>;
+	struct Update
+	{
+		UpdateFlags flags{};
+		Types::Region damage{};
+		Types::Moves moves{};
+		Types::Screens screens{};
+		std::shared_ptr<const Types::Cursor> cursorShape{};
+		Types::Point cursorPosition{};
+		// monotonic time when the oldest damage of this update was captured
+		std::chrono::steady_clock::time_point captureTime{};
+		// copy of the framebuffer including this update's damage which clients are served from
+		std::shared_ptr<const Types::Image> snapshot{};
+	};
 
 	~Framebuffer() override;
 
 	virtual void* data() const = 0;
 	virtual Types::Size size() const = 0;
 
-	virtual UpdateFlags update( const RectangleVisitor& visitor ) = 0;
+	// layout of data() - defaults to tightly packed 32 bit pixels
+	virtual Types::PixelFormat pixelFormat() const
+	{
+		return Types::PixelFormat::xrgb8888();
+	}
+
+	// distance between the starts of two lines, may include padding
+	virtual int bytesPerLine() const
+	{
+		return size().width() * pixelFormat().bytesPerPixel();
+	}
+
+	// adds all changes since the last call to damage - content known to have
+	// been copied within the framebuffer may be reported as moves instead
+	virtual UpdateFlags update( Types::Region* damage, Types::Moves* moves ) = 0;
 
 	virtual Types::Screens availableScreens() const = 0;
 
+	// framebuffers which leave the cursor out of data() report it here and
+	// signal changes through UpdateFlag::CursorShapeChanged and CursorMoved -
+	// a null shape hides the cursor
+	virtual std::shared_ptr<const Types::Cursor> cursorShape() const
+	{
+		return {};
+	}
+
+	virtual Types::Point cursorPosition() const
+	{
+		return {};
+	}
+
+	// hint about the part of the framebuffer clients are interested in -
+	// implementations may skip capturing everything outside of it
+	virtual void setCaptureArea( Types::Rectangle )
+	{
+	}
+
+	// handle which becomes readable/signaled as soon as update() will report
+	// new damage - framebuffers without such notification are polled instead
+	virtual Types::EventHandle damageEvent() const
+	{
+		return Types::InvalidEventHandle;
+	}
+
 };
 
 }
@@ -46,6 +46,8 @@ public:
 	{
 		None,
 		ProvidesDefaultImplementation = 0x0001,
+		// only created when asked for by uid or name, e.g. for testing purposes
+		RequiresExplicitSelection = 0x0002,
 		_
 	} ;
 	using Flags = flag_set<Flag>;
@@ -24,7 +24,11 @@
 
 #pragma once
 
+#include <vector>
+
+#include "Framebuffer.h"
 #include "Plugin.h"
+#include "libanyvnc/types/EventHandle.h"
 
 namespace AnyVnc
 {
@@ -45,9 +49,17 @@ public:
 	~ServerBackend() override;
 
 	virtual bool initialize( Core::Server* server ) = 0;
-	virtual bool handleFramebufferUpdate() = 0;
+	virtual bool handleFramebufferUpdate( const Framebuffer::Update& update ) = 0;
+	virtual bool reconfigure() = 0;
 	virtual bool hasConnectedClients() const = 0;
 	virtual bool hasPendingClientUpdateRequests() const = 0;
+	virtual size_t pendingClientUpdates() const = 0;
+	virtual Types::Rectangle viewedArea() const = 0;
+	virtual bool waitForEvents( int timeout, Types::EventHandle damageEvent ) = 0;
+	// handles (e.g. sockets) which become readable when processEvents() has work to do
+	virtual void collectEventHandles( std::vector<Types::EventHandle>* handles ) const = 0;
+	// reads pending client messages and injects input without sending updates
+	virtual bool processInputEvents() = 0;
 	virtual bool processEvents( int timeout ) = 0;
 	virtual bool shutdown() = 0;
 
@@ -0,0 +1,110 @@
+/*
+ * SharedFramebufferLayout.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace AnyVnc
+{
+
+namespace Producer
+{
+
+// Memory layout of a shared framebuffer segment (POSIX shared memory object)
+// written by a single producer and read by the framebuffer-sharedmemory plugin:
+//
+//   SharedFramebufferHeader   geometry, pixel format and the change ring
+//   pixel data                height * bytesPerLine bytes at dataOffset
+//
+// The producer first modifies the pixel data, then writes a change record to
+// changes[counter % MaxChanges] and finally increments counter (release). The
+// consumer reads all records between the last counter it has seen and the
+// current one. The producer never waits for the consumer, so if the distance
+// reaches MaxChanges before or after reading the records, some of them may
+// have been overwritten and the whole framebuffer counts as damaged. The
+// counter wraps around, distances are always computed modulo 2^32.
+//
+// On Linux the counter doubles as futex word, producers wake waiters with
+// FUTEX_WAKE after each batch of changes.
+
+static constexpr auto SharedFramebufferDefaultName = "/anyvnc-framebuffer";
+
+struct SharedFramebufferChange
+{
+	enum Type : uint32_t
+	{
+		Damage = 1,
+		// area has been copied from x-dx/y-dy, sent to clients as CopyRect
+		Move = 2
+	};
+
+	uint32_t type;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	int32_t dx;
+	int32_t dy;
+	uint32_t reserved;
+};
+
+static_assert( sizeof(SharedFramebufferChange) == 32, "unexpected size of SharedFramebufferChange" );
+
+struct SharedFramebufferHeader
+{
+	static constexpr uint32_t Magic = 0x41564e43;
+	static constexpr uint32_t CurrentVersion = 1;
+	static constexpr uint32_t MaxChanges = 4096;
+
+	uint32_t magic;
+	uint32_t version;
+	uint32_t dataOffset;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerLine;
+	uint32_t bitsPerPixel;
+	uint32_t depth;
+	uint32_t redMax;
+	uint32_t greenMax;
+	uint32_t blueMax;
+	uint32_t redShift;
+	uint32_t greenShift;
+	uint32_t blueShift;
+
+	// set by the producer before it removes the segment
+	std::atomic<uint32_t> closed;
+
+	alignas(64) std::atomic<uint32_t> counter;
+
+	alignas(64) SharedFramebufferChange changes[MaxChanges];
+};
+
+static_assert( std::atomic<uint32_t>::is_always_lock_free, "shared atomics have to be lock-free" );
+static_assert( sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "counter has to be usable as futex word" );
+
+}
+
+}
@@ -0,0 +1,288 @@
+/*
+ * SharedFramebufferProducer.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include "SharedFramebufferProducer.h"
+
+namespace AnyVnc
+{
+
+namespace Producer
+{
+
+static void wakeConsumers( std::atomic<uint32_t>* counter )
+{
+#ifdef __linux__
+	syscall( SYS_futex, reinterpret_cast<uint32_t *>( counter ), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+#else
+	// consumers poll the counter
+	(void) counter;
+#endif
+}
+
+
+
+SharedFramebufferProducer::~SharedFramebufferProducer()
+{
+	destroy();
+}
+
+
+
+bool SharedFramebufferProducer::create( const std::string& name, Types::Size size, const Types::PixelFormat& pixelFormat )
+{
+	static constexpr size_t PageSize = 4096;
+
+	destroy();
+
+	if( size.width() <= 0 || size.height() <= 0 )
+	{
+		return false;
+	}
+
+	const auto bytesPerLine = ( size_t(size.width()) * size_t(pixelFormat.bytesPerPixel()) + 3 ) & ~size_t(3);
+	const auto dataOffset = ( sizeof(SharedFramebufferHeader) + PageSize - 1 ) & ~( PageSize - 1 );
+	const auto mappingSize = dataOffset + bytesPerLine * size_t(size.height());
+
+	// a segment left behind by a crashed producer must not be reused by the consumer
+	shm_unlink( name.c_str() );
+
+	const auto fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600 );
+	if( fd < 0 )
+	{
+		std::cerr << "SharedFramebufferProducer: could not create " << name << std::endl;
+		return false;
+	}
+
+	if( ftruncate( fd, off_t(mappingSize) ) != 0 )
+	{
+		close( fd );
+		shm_unlink( name.c_str() );
+		return false;
+	}
+
+	const auto mapping = mmap( nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if( mapping == MAP_FAILED )
+	{
+		shm_unlink( name.c_str() );
+		return false;
+	}
+
+	const auto header = new( mapping ) SharedFramebufferHeader();
+	header->version = SharedFramebufferHeader::CurrentVersion;
+	header->dataOffset = uint32_t(dataOffset);
+	header->width = uint32_t(size.width());
+	header->height = uint32_t(size.height());
+	header->bytesPerLine = uint32_t(bytesPerLine);
+	header->bitsPerPixel = uint32_t(pixelFormat.bitsPerPixel());
+	header->depth = uint32_t(pixelFormat.depth());
+	header->redMax = uint32_t(pixelFormat.redMax());
+	header->greenMax = uint32_t(pixelFormat.greenMax());
+	header->blueMax = uint32_t(pixelFormat.blueMax());
+	header->redShift = uint32_t(pixelFormat.redShift());
+	header->greenShift = uint32_t(pixelFormat.greenShift());
+	header->blueShift = uint32_t(pixelFormat.blueShift());
+
+	// consumers only accept the segment once everything else has been set up
+	std::atomic_thread_fence( std::memory_order_release );
+	header->magic = SharedFramebufferHeader::Magic;
+
+	m_name = name;
+	m_header = header;
+	m_mappingSize = mappingSize;
+	m_counter = 0;
+
+	return true;
+}
+
+
+
+void SharedFramebufferProducer::destroy()
+{
+	if( m_header == nullptr )
+	{
+		return;
+	}
+
+	m_header->closed.store( 1, std::memory_order_release );
+	wakeConsumers( &m_header->counter );
+
+	munmap( m_header, m_mappingSize );
+	shm_unlink( m_name.c_str() );
+
+	m_header = nullptr;
+	m_mappingSize = 0;
+}
+
+
+
+void* SharedFramebufferProducer::data() const
+{
+	return m_header ? reinterpret_cast<uint8_t *>( m_header ) + m_header->dataOffset : nullptr;
+}
+
+
+
+Types::Size SharedFramebufferProducer::size() const
+{
+	return m_header ? Types::Size{ int(m_header->width), int(m_header->height) } : Types::Size{};
+}
+
+
+
+int SharedFramebufferProducer::bytesPerLine() const
+{
+	return m_header ? int(m_header->bytesPerLine) : 0;
+}
+
+
+
+void SharedFramebufferProducer::addDamage( const Types::Rectangle& rect )
+{
+	if( m_header == nullptr )
+	{
+		return;
+	}
+
+	const auto clippedRect = rect.intersected( { 0, 0, int(m_header->width) - 1, int(m_header->height) - 1 } );
+	if( clippedRect.isEmpty() )
+	{
+		return;
+	}
+
+	append( { SharedFramebufferChange::Damage, clippedRect.left(), clippedRect.top(),
+			  clippedRect.width(), clippedRect.height(), 0, 0, 0 } );
+}
+
+
+
+void SharedFramebufferProducer::addMove( const Types::Move& move )
+{
+	if( m_header == nullptr )
+	{
+		return;
+	}
+
+	const Types::Rectangle bounds{ 0, 0, int(m_header->width) - 1, int(m_header->height) - 1 };
+	const auto& destination = move.destination();
+
+	if( destination.isEmpty() ||
+		destination.intersected( bounds ) != destination ||
+		move.source().intersected( bounds ) != move.source() )
+	{
+		addDamage( destination );
+		return;
+	}
+
+	append( { SharedFramebufferChange::Move, destination.left(), destination.top(),
+			  destination.width(), destination.height(), move.dx(), move.dy(), 0 } );
+}
+
+
+
+void SharedFramebufferProducer::copy( const Types::Move& move )
+{
+	if( m_header == nullptr )
+	{
+		return;
+	}
+
+	const Types::Rectangle bounds{ 0, 0, int(m_header->width) - 1, int(m_header->height) - 1 };
+	const auto& destination = move.destination();
+	const auto source = move.source();
+
+	if( destination.isEmpty() ||
+		destination.intersected( bounds ) != destination ||
+		source.intersected( bounds ) != source )
+	{
+		return;
+	}
+
+	const auto pixels = static_cast<uint8_t *>( data() );
+	const auto bytesPerPixel = size_t(m_header->bitsPerPixel / 8);
+	const auto length = size_t(destination.width()) * bytesPerPixel;
+
+	// copy in the direction which doesn't overwrite lines not copied yet
+	const auto copyLine = [&]( int row ) {
+		memmove( pixels + size_t(destination.top() + row) * m_header->bytesPerLine + size_t(destination.left()) * bytesPerPixel,
+				 pixels + size_t(source.top() + row) * m_header->bytesPerLine + size_t(source.left()) * bytesPerPixel,
+				 length );
+	};
+
+	if( move.dy() > 0 )
+	{
+		for( int row = destination.height() - 1; row >= 0; --row )
+		{
+			copyLine( row );
+		}
+	}
+	else
+	{
+		for( int row = 0; row < destination.height(); ++row )
+		{
+			copyLine( row );
+		}
+	}
+
+	addMove( move );
+}
+
+
+
+void SharedFramebufferProducer::commit()
+{
+	if( m_header )
+	{
+		wakeConsumers( &m_header->counter );
+	}
+}
+
+
+
+void SharedFramebufferProducer::append( const SharedFramebufferChange& change )
+{
+	m_header->changes[m_counter % SharedFramebufferHeader::MaxChanges] = change;
+
+	++m_counter;
+	m_header->counter.store( m_counter, std::memory_order_release );
+}
+
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+ * SharedFramebufferProducer.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <string>
+
+#include "libanyvnc/producer/AnyVncProducer.h"
+#include "libanyvnc/producer/SharedFramebufferLayout.h"
+#include "libanyvnc/types/Move.h"
+#include "libanyvnc/types/PixelFormat.h"
+#include "libanyvnc/types/Rectangle.h"
+#include "libanyvnc/types/Size.h"
+
+namespace AnyVnc
+{
+
+namespace Producer
+{
+
+// lets other processes (e.g. compositors) render directly into a framebuffer
+// served by the framebuffer-sharedmemory plugin - not thread-safe, changes
+// have to be made from a single thread
+class ANYVNC_PRODUCER_EXPORT SharedFramebufferProducer
+{
+public:
+	SharedFramebufferProducer() = default;
+	~SharedFramebufferProducer();
+
+	SharedFramebufferProducer( const SharedFramebufferProducer& ) = delete;
+	SharedFramebufferProducer& operator=( const SharedFramebufferProducer& ) = delete;
+
+	// replaces an existing segment of the same name
+	bool create( const std::string& name, Types::Size size,
+				 const Types::PixelFormat& pixelFormat = Types::PixelFormat::xrgb8888() );
+	void destroy();
+
+	bool isValid() const
+	{
+		return m_header != nullptr;
+	}
+
+	void* data() const;
+	Types::Size size() const;
+	int bytesPerLine() const;
+
+	// records changes made to data() - moved pixels have to be copied before
+	void addDamage( const Types::Rectangle& rect );
+	void addMove( const Types::Move& move );
+
+	// copies the pixels of move.source() to move.destination() and records the move
+	void copy( const Types::Move& move );
+
+	// wakes up the consumer after a batch of changes
+	void commit();
+
+private:
+	void append( const SharedFramebufferChange& change );
+
+	std::string m_name;
+	SharedFramebufferHeader* m_header{nullptr};
+	size_t m_mappingSize{0};
+	uint32_t m_counter{0};
+
+};
+
+}
+
+}
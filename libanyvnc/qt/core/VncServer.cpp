@@ -30,6 +30,14 @@ namespace AnyVncQt::Core
 VncServer::VncServer( QObject* parent ) :
     QObject( parent )
 {
+	m_statisticsTimer.setInterval( StatisticsUpdateInterval );
+	connect( &m_statisticsTimer, &QTimer::timeout, this, &VncServer::statisticsChanged );
+
+	// also stops when the server fails instead of being stopped through setRunning()
+	connect( &m_serverWatcher, &QFutureWatcher<void>::finished, this, [this]() {
+		m_statisticsTimer.stop();
+		Q_EMIT runningChanged();
+	} );
 }
 
 
@@ -91,18 +99,77 @@ void VncServer::setRunning( bool running )
 				m_quit = false;
 				while( m_quit == false )
 				{
-					m_server->run();
+					// retrying makes no sense if plugins or the framebuffer fail
+					if( m_server->run() == false )
+					{
+						break;
+					}
 				}
 			} );
+			m_serverWatcher.setFuture( m_serverRunnable );
+
+			m_statisticsTimer.start();
 		}
 		else
 		{
 			m_quit = true;
 			m_server->quit();
+
+			m_statisticsTimer.stop();
 		}
 
 		Q_EMIT runningChanged();
 	}
 }
 
+
+
+QVariantMap VncServer::statistics() const
+{
+	using Instrumentation = AnyVnc::Core::Instrumentation;
+
+	const auto summaryToMap = []( const Instrumentation::Histogram::Summary& summary ) {
+		return QVariantMap{
+			{ QStringLiteral("count"), quint64(summary.count) },
+			{ QStringLiteral("mean"), qint64(summary.mean.count()) },
+			{ QStringLiteral("p50"), qint64(summary.p50.count()) },
+			{ QStringLiteral("p99"), qint64(summary.p99.count()) },
+			{ QStringLiteral("max"), qint64(summary.max.count()) }
+		};
+	};
+
+	const auto report = m_server->instrumentation().report();
+
+	QVariantMap statistics;
+
+	for( size_t i = 0; i < report.stages.size(); ++i )
+	{
+		statistics[QString::fromLatin1( Instrumentation::name( Instrumentation::Stage(i) ) )] = summaryToMap( report.stages[i] );
+	}
+
+	for( size_t i = 0; i < report.counters.size(); ++i )
+	{
+		statistics[QString::fromLatin1( Instrumentation::name( Instrumentation::Counter(i) ) )] = quint64(report.counters[i]);
+	}
+
+	// damage age at send per client
+	QVariantMap clients;
+	for( const auto& client : report.clients )
+	{
+		clients[QString::fromStdString( client.first )] = summaryToMap( client.second );
+	}
+	statistics[QStringLiteral("clients")] = clients;
+
+	return statistics;
+}
+
+
+
+void VncServer::resetStatistics()
+{
+	m_server->instrumentation().reset();
+
+	Q_EMIT statisticsChanged();
+}
+
 }
@@ -23,6 +23,8 @@
  */
 
 #include <QtConcurrent>
+#include <QTimer>
+#include <QVariantMap>
 
 #include "libanyvnc/core/Server.h"
 
@@ -40,6 +42,7 @@ class ANYVNC_QT_CORE_EXPORT VncServer : public QObject
 	Q_PROPERTY(int port READ port WRITE setPort NOTIFY portChanged)
 	Q_PROPERTY(QString password READ password WRITE setPassword NOTIFY passwordChanged)
 	Q_PROPERTY(bool running READ running WRITE setRunning NOTIFY runningChanged)
+	Q_PROPERTY(QVariantMap statistics READ statistics NOTIFY statisticsChanged)
 public:
 	VncServer( QObject* parent = nullptr );
 
@@ -52,17 +55,27 @@ public:
 	bool running() const;
 	void setRunning( bool running );
 
+	// per-stage timings in microseconds and counters, refreshed periodically while running
+	QVariantMap statistics() const;
+	Q_INVOKABLE void resetStatistics();
+
 Q_SIGNALS:
 	void portChanged();
 	void passwordChanged();
 	void runningChanged();
+	void statisticsChanged();
 
 private:
+	static constexpr auto StatisticsUpdateInterval = 1000;
+
 	AnyVnc::Core::Server* m_server{new AnyVnc::Core::Server};
 
 	QFuture<void> m_serverRunnable;
+	QFutureWatcher<void> m_serverWatcher{this};
 	QAtomicInt m_quit;
 
+	QTimer m_statisticsTimer{this};
+
 };
 
 }
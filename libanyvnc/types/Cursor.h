@@ -0,0 +1,93 @@
+/*
+ * types/Cursor.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "libanyvnc/types/Point.h"
+#include "libanyvnc/types/Size.h"
+
+namespace AnyVnc
+{
+
+namespace Types
+{
+
+// cursor image with straight (not premultiplied) 0xAARRGGBB pixels
+class Cursor
+{
+public:
+	Cursor( Size size, Point hotSpot, std::vector<uint32_t>&& pixels ) :
+		m_size( size ),
+		m_hotSpot( hotSpot ),
+		m_pixels( std::move(pixels) )
+	{
+		m_pixels.resize( size_t(std::max( size.width(), 0 )) * size_t(std::max( size.height(), 0 )) );
+	}
+
+	bool operator==( const Cursor& other ) const
+	{
+		return m_size == other.m_size &&
+			   m_hotSpot.x() == other.m_hotSpot.x() && m_hotSpot.y() == other.m_hotSpot.y() &&
+			   m_pixels == other.m_pixels;
+	}
+
+	bool operator!=( const Cursor& other ) const
+	{
+		return !( *this == other );
+	}
+
+	Size size() const
+	{
+		return m_size;
+	}
+
+	Point hotSpot() const
+	{
+		return m_hotSpot;
+	}
+
+	const std::vector<uint32_t>& pixels() const
+	{
+		return m_pixels;
+	}
+
+	uint32_t pixel( int x, int y ) const
+	{
+		return m_pixels[size_t(y) * size_t(m_size.width()) + size_t(x)];
+	}
+
+private:
+	Size m_size;
+	Point m_hotSpot;
+	std::vector<uint32_t> m_pixels;
+
+};
+
+}
+
+}
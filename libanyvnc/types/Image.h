@@ -0,0 +1,89 @@
+/*
+ * types/Image.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Size.h"
+
+namespace AnyVnc
+{
+
+namespace Types
+{
+
+// block of pixel rows owned by the image itself
+class Image
+{
+public:
+	Image( Size size, int bytesPerLine ) :
+		m_size( size ),
+		m_bytesPerLine( bytesPerLine ),
+		m_data( size_t(bytesPerLine) * size_t(std::max( size.height(), 0 )) )
+	{
+	}
+
+	Size size() const
+	{
+		return m_size;
+	}
+
+	int bytesPerLine() const
+	{
+		return m_bytesPerLine;
+	}
+
+	uint8_t* data()
+	{
+		return m_data.data();
+	}
+
+	const uint8_t* data() const
+	{
+		return m_data.data();
+	}
+
+	uint8_t* scanLine( int y )
+	{
+		return m_data.data() + size_t(y) * size_t(m_bytesPerLine);
+	}
+
+	const uint8_t* scanLine( int y ) const
+	{
+		return m_data.data() + size_t(y) * size_t(m_bytesPerLine);
+	}
+
+private:
+	Size m_size;
+	int m_bytesPerLine;
+	std::vector<uint8_t> m_data;
+
+};
+
+}
+
+}
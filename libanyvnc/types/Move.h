@@ -0,0 +1,92 @@
+/*
+ * types/Move.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "libanyvnc/types/Rectangle.h"
+#include "libanyvnc/types/Region.h"
+
+namespace AnyVnc
+{
+
+namespace Types
+{
+
+// pixels copied to destination from the same sized area at an offset of -dx/-dy,
+// e.g. caused by scrolling or dragging a window - sent to clients as CopyRect
+class Move
+{
+public:
+	Move( const Rectangle& destination, int dx, int dy ) :
+		m_destination( destination ),
+		m_dx( dx ),
+		m_dy( dy )
+	{
+	}
+
+	const Rectangle& destination() const
+	{
+		return m_destination;
+	}
+
+	Rectangle source() const
+	{
+		return { m_destination.left() - m_dx, m_destination.top() - m_dy,
+				 m_destination.right() - m_dx, m_destination.bottom() - m_dy };
+	}
+
+	int dx() const
+	{
+		return m_dx;
+	}
+
+	int dy() const
+	{
+		return m_dy;
+	}
+
+private:
+	Rectangle m_destination;
+	int m_dx;
+	int m_dy;
+
+};
+
+// moves are applied in order, all of them before any damage
+using Moves = std::vector<Move>;
+
+// appends a move which happened after the given damage - damage within its
+// source moves along so the copied pixels get refreshed afterwards
+inline void appendMove( const Move& move, Region* damage, Moves* moves )
+{
+	const auto movedDamage = damage->intersected( move.source() ).translated( move.dx(), move.dy() );
+	damage->add( movedDamage );
+	moves->push_back( move );
+}
+
+}
+
+}
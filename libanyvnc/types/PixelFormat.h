@@ -24,34 +24,128 @@
 
 #pragma once
 
+#include <algorithm>
+
 namespace AnyVnc
 {
 
 namespace Types
 {
 
+// layout of true colour pixels in memory as described by RFB - samples
+// are extracted via ( pixel >> shift ) & max with pixels in host byte order
 class PixelFormat
 {
 public:
+	PixelFormat( int bitsPerPixel, int depth,
+				 int redMax, int greenMax, int blueMax,
+				 int redShift, int greenShift, int blueShift ) :
+		m_bitsPerPixel( bitsPerPixel ),
+		m_depth( depth ),
+		m_redMax( redMax ),
+		m_greenMax( greenMax ),
+		m_blueMax( blueMax ),
+		m_redShift( redShift ),
+		m_greenShift( greenShift ),
+		m_blueShift( blueShift )
+	{
+	}
+
+	// 0x00RRGGBB
+	static PixelFormat xrgb8888()
+	{
+		return { 32, 24, 255, 255, 255, 16, 8, 0 };
+	}
+
+	// 0bRRRRRGGGGGGBBBBB
+	static PixelFormat rgb565()
+	{
+		return { 16, 16, 31, 63, 31, 11, 5, 0 };
+	}
+
+	bool operator==( const PixelFormat& other ) const
+	{
+		return m_bitsPerPixel == other.m_bitsPerPixel && m_depth == other.m_depth &&
+			   m_redMax == other.m_redMax && m_greenMax == other.m_greenMax && m_blueMax == other.m_blueMax &&
+			   m_redShift == other.m_redShift && m_greenShift == other.m_greenShift && m_blueShift == other.m_blueShift;
+	}
+
+	bool operator!=( const PixelFormat& other ) const
+	{
+		return !( *this == other );
+	}
+
+	int bitsPerPixel() const
+	{
+		return m_bitsPerPixel;
+	}
+
 	int bytesPerPixel() const
 	{
-		return m_bytesPerPixel;
+		return m_bitsPerPixel / 8;
 	}
 
-	int bytesPerSample() const
+	int depth() const
 	{
-		return m_bytesPerSample;
+		return m_depth;
+	}
+
+	// bits of the widest sample
+	int bitsPerSample() const
+	{
+		int bits = 0;
+		while( ( std::max( { m_redMax, m_greenMax, m_blueMax } ) >> bits ) > 0 )
+		{
+			++bits;
+		}
+		return bits;
 	}
 
 	int samplesPerPixel() const
 	{
-		return m_samplesPerPixel;
+		return 3;
+	}
+
+	int redMax() const
+	{
+		return m_redMax;
+	}
+
+	int greenMax() const
+	{
+		return m_greenMax;
+	}
+
+	int blueMax() const
+	{
+		return m_blueMax;
+	}
+
+	int redShift() const
+	{
+		return m_redShift;
+	}
+
+	int greenShift() const
+	{
+		return m_greenShift;
+	}
+
+	int blueShift() const
+	{
+		return m_blueShift;
 	}
 
 private:
-	int m_bytesPerPixel;
-	int m_bytesPerSample;
-	int m_samplesPerPixel;
+	int m_bitsPerPixel;
+	int m_depth;
+	int m_redMax;
+	int m_greenMax;
+	int m_blueMax;
+	int m_redShift;
+	int m_greenShift;
+	int m_blueShift;
+
 };
 
 }
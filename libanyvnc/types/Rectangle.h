@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <algorithm>
+
 namespace AnyVnc
 {
 
@@ -41,11 +43,37 @@ public:
 	{
 	}
 
+	bool operator==( const Rectangle& other ) const
+	{
+		return m_left == other.m_left && m_top == other.m_top &&
+			   m_right == other.m_right && m_bottom == other.m_bottom;
+	}
+
+	bool operator!=( const Rectangle& other ) const
+	{
+		return !( *this == other );
+	}
+
 	bool isValid() const
 	{
 		return m_left >= 0 && m_right >= 0 && m_top >= 0 && m_bottom >= 0;
 	}
 
+	bool isEmpty() const
+	{
+		return m_right < m_left || m_bottom < m_top;
+	}
+
+	int width() const
+	{
+		return m_right - m_left + 1;
+	}
+
+	int height() const
+	{
+		return m_bottom - m_top + 1;
+	}
+
 	int left() const
 	{
 		return m_left;
@@ -86,6 +114,38 @@ public:
 		m_bottom = bottom;
 	}
 
+	bool intersects( const Rectangle& other ) const
+	{
+		return intersected( other ).isEmpty() == false;
+	}
+
+	Rectangle intersected( const Rectangle& other ) const
+	{
+		return { std::max( m_left, other.m_left ), std::max( m_top, other.m_top ),
+				 std::min( m_right, other.m_right ), std::min( m_bottom, other.m_bottom ) };
+	}
+
+	Rectangle united( const Rectangle& other ) const
+	{
+		if( isEmpty() || isValid() == false )
+		{
+			return other;
+		}
+
+		if( other.isEmpty() || other.isValid() == false )
+		{
+			return *this;
+		}
+
+		return { std::min( m_left, other.m_left ), std::min( m_top, other.m_top ),
+				 std::max( m_right, other.m_right ), std::max( m_bottom, other.m_bottom ) };
+	}
+
+	Rectangle translated( int dx, int dy ) const
+	{
+		return { m_left + dx, m_top + dy, m_right + dx, m_bottom + dy };
+	}
+
 private:
 	int m_left;
 	int m_top;
@@ -0,0 +1,349 @@
+/*
+ * types/Region.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Rectangle.h"
+
+namespace AnyVnc
+{
+
+namespace Types
+{
+
+// set of pixels stored as horizontal bands of non-overlapping spans -
+// rectangles are collected in bulk and coalesced lazily in one sweep
+class Region
+{
+public:
+	Region() = default;
+
+	Region( const Rectangle& rect )
+	{
+		add( rect );
+	}
+
+	void add( const Rectangle& rect )
+	{
+		if( rect.isValid() && rect.isEmpty() == false )
+		{
+			m_pending.push_back( { rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1 } );
+		}
+	}
+
+	void add( const Region& other )
+	{
+		other.forEachBox( [this]( const Box& box ) { m_pending.push_back( box ); } );
+	}
+
+	void clear()
+	{
+		m_bands.clear();
+		m_pending.clear();
+	}
+
+	bool isEmpty() const
+	{
+		normalize();
+		return m_bands.empty();
+	}
+
+	size_t rectangleCount() const
+	{
+		normalize();
+
+		size_t count = 0;
+		for( const auto& band : m_bands )
+		{
+			count += band.spans.size();
+		}
+
+		return count;
+	}
+
+	uint64_t area() const
+	{
+		uint64_t area = 0;
+		forEachBox( [&area]( const Box& box ) {
+			area += uint64_t( box.right - box.left ) * uint64_t( box.bottom - box.top );
+		} );
+
+		return area;
+	}
+
+	Rectangle boundingRect() const
+	{
+		normalize();
+
+		if( m_bands.empty() )
+		{
+			return {};
+		}
+
+		int left = m_bands.front().spans.front().left;
+		int right = m_bands.front().spans.back().right;
+		for( const auto& band : m_bands )
+		{
+			left = std::min( left, band.spans.front().left );
+			right = std::max( right, band.spans.back().right );
+		}
+
+		return { left, m_bands.front().top, right - 1, m_bands.back().bottom - 1 };
+	}
+
+	std::vector<Rectangle> rectangles() const
+	{
+		std::vector<Rectangle> rectangles;
+		forEachBox( [&rectangles]( const Box& box ) {
+			rectangles.emplace_back( box.left, box.top, box.right - 1, box.bottom - 1 );
+		} );
+
+		return rectangles;
+	}
+
+	Region intersected( const Rectangle& rect ) const
+	{
+		normalize();
+
+		Region region;
+
+		if( rect.isEmpty() )
+		{
+			return region;
+		}
+
+		const auto clipRight = rect.right() + 1;
+		const auto clipBottom = rect.bottom() + 1;
+
+		for( const auto& band : m_bands )
+		{
+			const auto top = std::max( band.top, rect.top() );
+			const auto bottom = std::min( band.bottom, clipBottom );
+			if( top >= bottom )
+			{
+				continue;
+			}
+
+			Band clippedBand{ top, bottom, {} };
+			for( const auto& span : band.spans )
+			{
+				const auto left = std::max( span.left, rect.left() );
+				const auto right = std::min( span.right, clipRight );
+				if( left < right )
+				{
+					clippedBand.spans.push_back( { left, right } );
+				}
+			}
+
+			region.appendBand( std::move(clippedBand) );
+		}
+
+		return region;
+	}
+
+	Region translated( int dx, int dy ) const
+	{
+		normalize();
+
+		Region region;
+		region.m_bands = m_bands;
+
+		for( auto& band : region.m_bands )
+		{
+			band.top += dy;
+			band.bottom += dy;
+			for( auto& span : band.spans )
+			{
+				span.left += dx;
+				span.right += dx;
+			}
+		}
+
+		return region;
+	}
+
+private:
+	// half-open coordinates
+	struct Box
+	{
+		int left;
+		int top;
+		int right;
+		int bottom;
+	};
+
+	struct Span
+	{
+		int left;
+		int right;
+
+		bool operator==( const Span& other ) const
+		{
+			return left == other.left && right == other.right;
+		}
+	};
+
+	struct Band
+	{
+		int top;
+		int bottom;
+		std::vector<Span> spans;
+	};
+
+	template<class Visitor>
+	void forEachBox( const Visitor& visitor ) const
+	{
+		normalize();
+
+		for( const auto& band : m_bands )
+		{
+			for( const auto& span : band.spans )
+			{
+				visitor( Box{ span.left, band.top, span.right, band.bottom } );
+			}
+		}
+	}
+
+	// merges with the previous band if both are adjacent and cover the same spans
+	void appendBand( Band&& band ) const
+	{
+		if( band.spans.empty() )
+		{
+			return;
+		}
+
+		if( m_bands.empty() == false &&
+			m_bands.back().bottom == band.top &&
+			m_bands.back().spans == band.spans )
+		{
+			m_bands.back().bottom = band.bottom;
+		}
+		else
+		{
+			m_bands.push_back( std::move(band) );
+		}
+	}
+
+	void normalize() const
+	{
+		if( m_pending.empty() )
+		{
+			return;
+		}
+
+		auto boxes = std::move(m_pending);
+		m_pending.clear();
+
+		for( const auto& band : m_bands )
+		{
+			for( const auto& span : band.spans )
+			{
+				boxes.push_back( { span.left, band.top, span.right, band.bottom } );
+			}
+		}
+
+		m_bands.clear();
+
+		std::sort( boxes.begin(), boxes.end(), []( const Box& a, const Box& b ) { return a.top < b.top; } );
+
+		std::vector<int> edges;
+		edges.reserve( boxes.size() * 2 );
+		for( const auto& box : boxes )
+		{
+			edges.push_back( box.top );
+			edges.push_back( box.bottom );
+		}
+		std::sort( edges.begin(), edges.end() );
+		edges.erase( std::unique( edges.begin(), edges.end() ), edges.end() );
+
+		// sweep top to bottom, keeping the boxes covering the current band
+		std::vector<Span> active;
+		std::vector<int> activeBottoms;
+		size_t nextBox = 0;
+
+		for( size_t i = 0; i + 1 < edges.size(); ++i )
+		{
+			const auto top = edges[i];
+			const auto bottom = edges[i+1];
+
+			for( size_t j = 0; j < active.size(); )
+			{
+				if( activeBottoms[j] <= top )
+				{
+					active[j] = active.back();
+					active.pop_back();
+					activeBottoms[j] = activeBottoms.back();
+					activeBottoms.pop_back();
+				}
+				else
+				{
+					++j;
+				}
+			}
+
+			while( nextBox < boxes.size() && boxes[nextBox].top <= top )
+			{
+				active.push_back( { boxes[nextBox].left, boxes[nextBox].right } );
+				activeBottoms.push_back( boxes[nextBox].bottom );
+				++nextBox;
+			}
+
+			if( active.empty() )
+			{
+				continue;
+			}
+
+			auto spans = active;
+			std::sort( spans.begin(), spans.end(), []( const Span& a, const Span& b ) { return a.left < b.left; } );
+
+			// merge overlapping and touching spans
+			Band band{ top, bottom, {} };
+			for( const auto& span : spans )
+			{
+				if( band.spans.empty() == false && span.left <= band.spans.back().right )
+				{
+					band.spans.back().right = std::max( band.spans.back().right, span.right );
+				}
+				else
+				{
+					band.spans.push_back( span );
+				}
+			}
+
+			appendBand( std::move(band) );
+		}
+	}
+
+	mutable std::vector<Band> m_bands;
+	mutable std::vector<Box> m_pending;
+
+};
+
+}
+
+}
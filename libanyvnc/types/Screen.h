@@ -26,6 +26,8 @@
 
 #include <vector>
 
+#include "libanyvnc/types/Point.h"
+#include "libanyvnc/types/Rectangle.h"
 #include "libanyvnc/types/Size.h"
 
 namespace AnyVnc
@@ -37,17 +39,40 @@ namespace Types
 class Screen
 {
 public:
-	Screen( Size size, int depth ) :
+	Screen( Size size, int depth, Point position = {} ) :
 		m_size( size ),
-		m_depth( depth )
+		m_depth( depth ),
+		m_position( position )
 	{
 	}
 
+	bool operator==( const Screen& other ) const
+	{
+		return m_size == other.m_size && m_depth == other.m_depth &&
+			   m_position.x() == other.m_position.x() && m_position.y() == other.m_position.y();
+	}
+
+	bool operator!=( const Screen& other ) const
+	{
+		return !( *this == other );
+	}
+
 	Types::Size geometry() const
 	{
 		return m_size;
 	}
 
+	Types::Point position() const
+	{
+		return m_position;
+	}
+
+	Types::Rectangle rectangle() const
+	{
+		return { m_position.x(), m_position.y(),
+				 m_position.x() + m_size.width() - 1, m_position.y() + m_size.height() - 1 };
+	}
+
 	int colorDepth() const
 	{
 		return m_depth;
@@ -56,6 +81,7 @@ public:
 private:
 	Types::Size m_size;
 	int m_depth;
+	Types::Point m_position;
 };
 
 using Screens = std::vector<Screen>;
@@ -22,11 +22,17 @@
  *
  */
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
 
 #include "LibVncServerBackend.h"
 
+#include "libanyvnc/core/ScaledMirror.h"
 #include "libanyvnc/core/Server.h"
+#include "libanyvnc/core/WorkerPool.h"
 #include "libanyvnc/interfaces/Framebuffer.h"
 
 extern "C" {
@@ -37,9 +43,90 @@ extern "C" {
 namespace AnyVnc
 {
 
+// one rfbScreen serving either the whole framebuffer or a single screen of it
+struct LibVncServerView
+{
+	LibVncServerBackend* backend{nullptr};
+	rfbScreenInfoPtr rfbScreen{nullptr};
+	Types::Rectangle area;
+	Types::PixelFormat pixelFormat{Types::PixelFormat::xrgb8888()};
+	int screenIndex{-1};
+	std::string desktopName;
+	// downscaled copy of the whole framebuffer served instead of area
+	std::unique_ptr<Core::ScaledMirror> mirror;
+#ifdef WIN32
+	// signaled by the sockets of rfbScreen as they can't be waited for directly
+	WSAEVENT socketEvent{WSA_INVALID_EVENT};
+#endif
+};
+
+
+// rectangle of an update sent with a plugin encoder
+struct EncodedTile
+{
+	Types::Rectangle rect;
+	std::vector<uint8_t> data;
+	bool encoded{false};
+};
+
+
+// per-client state for measuring framebuffer updates
+struct LibVncClientData
+{
+	Core::Instrumentation::Clock::time_point updateStart;
+	int sentBytes{0};
+	// capture time of the oldest damage not sent to the client yet
+	Core::Instrumentation::Clock::time_point damageTime{};
+	Core::Instrumentation::ClientHistogram damageAge;
+	// plugin encoder for an encoding unknown to libvncserver preferred by the client
+	Interfaces::Encoder* announcedEncoder{nullptr};
+	// number of the SetEncodings message announcedEncoder was selected from
+	int announcedEncodings{0};
+	Interfaces::Encoder* encoder{nullptr};
+	std::unique_ptr<Interfaces::Encoder::ClientState> encoderState;
+	// consecutive updates the plugin encoder failed for and updates to leave to libvncserver because of it
+	int encoderFailures{0};
+	int encoderBackoff{0};
+};
+
+
+static LibVncServerView* clientView( rfbClientPtr cl )
+{
+	return reinterpret_cast<LibVncServerView *>( cl->screen->screenData );
+}
+
+
+
+#ifdef WIN32
+static void selectSocketEvents( const LibVncServerView* view )
+{
+	// (re-)associating signals the event again for network events still pending
+	// - this leaves the sockets non-blocking which libvncserver sets them up as anyway
+	WSAResetEvent( view->socketEvent );
+
+	const auto& fds = view->rfbScreen->allFds;
+	for( u_int i = 0; i < fds.fd_count; ++i )
+	{
+		WSAEventSelect( fds.fd_array[i], view->socketEvent, FD_ACCEPT | FD_READ | FD_CLOSE );
+	}
+}
+#endif
+
+
+
 static void handleClientGone( rfbClientPtr cl )
 {
 	std::cout << cl->host;
+
+	const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+	const auto view = clientView( cl );
+	if( clientData && view )
+	{
+		view->backend->server()->instrumentation().removeClient( clientData->damageAge );
+	}
+
+	delete clientData;
+	cl->clientData = nullptr;
 }
 
 
@@ -47,30 +134,181 @@ static rfbNewClientAction handleNewClient( rfbClientPtr cl )
 {
 	cl->clientGoneHook = handleClientGone;
 
+	const auto clientData = new LibVncClientData;
+	const auto view = clientView( cl );
+	if( view )
+	{
+		clientData->damageAge = view->backend->server()->instrumentation().addClient( cl->host );
+	}
+	cl->clientData = clientData;
+
 	std::cout << "New client connection from host" << cl->host;
 
 	return RFB_CLIENT_ACCEPT;
 }
 
 
+static void handleUpdateStart( rfbClientPtr cl )
+{
+	const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+	if( clientData )
+	{
+		clientData->updateStart = Core::Instrumentation::Clock::now();
+		clientData->sentBytes = rfbStatGetSentBytes( cl );
+	}
+}
+
+
+static void handleUpdateFinished( rfbClientPtr cl, int result )
+{
+	const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+	const auto view = clientView( cl );
+	if( clientData == nullptr || view == nullptr || result == false )
+	{
+		return;
+	}
+
+	using Instrumentation = Core::Instrumentation;
+	auto& instrumentation = view->backend->server()->instrumentation();
+
+	// libvncserver writes to the socket while encoding so this includes the socket writes
+	instrumentation.record( Instrumentation::Stage::Encode,
+							std::chrono::duration_cast<Instrumentation::Duration>(
+								Instrumentation::Clock::now() - clientData->updateStart ) );
+	instrumentation.add( Instrumentation::Counter::Bytes,
+						 uint32_t( rfbStatGetSentBytes( cl ) - clientData->sentBytes ) );
+	instrumentation.add( Instrumentation::Counter::Updates, 1 );
+
+	if( clientData->damageTime != Instrumentation::Clock::time_point{} )
+	{
+		const auto damageAge = std::chrono::duration_cast<Instrumentation::Duration>(
+								   Instrumentation::Clock::now() - clientData->damageTime );
+		instrumentation.record( Instrumentation::Stage::DamageAge, damageAge );
+		if( clientData->damageAge )
+		{
+			clientData->damageAge->record( damageAge );
+		}
+
+		clientData->damageTime = {};
+	}
+}
+
+
+
+static void markClientsDamaged( rfbScreenInfoPtr rfbScreen, Core::Instrumentation::Clock::time_point captureTime )
+{
+	rfbClientPtr cl;
+	auto iterator = rfbGetClientIterator( rfbScreen );
+	while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+	{
+		const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+		if( clientData && clientData->damageTime == Core::Instrumentation::Clock::time_point{} )
+		{
+			clientData->damageTime = captureTime;
+		}
+	}
+	rfbReleaseClientIterator( iterator );
+}
+
+
+static void markRegionModified( rfbScreenInfoPtr rfbScreen, const Types::Region& damage )
+{
+	// hand the whole damage over at once so that each client's modified region is updated only once
+	auto region = sraRgnCreate();
+	for( const auto& rect : damage.rectangles() )
+	{
+		auto rectRegion = sraRgnCreateRect( rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1 );
+		sraRgnOr( region, rectRegion );
+		sraRgnDestroy( rectRegion );
+	}
+
+	rfbMarkRegionAsModified( rfbScreen, region );
+	sraRgnDestroy( region );
+}
+
+
+static Interfaces::Encoder* findEncoder( const Core::Server* server, int encoding )
+{
+	for( const auto encoder : server->encoders() )
+	{
+		if( encoder->encoding() == encoding )
+		{
+			return encoder;
+		}
+	}
+
+	return nullptr;
+}
+
+
+
+static rfbBool enableEncoder( rfbClientPtr cl, void**, int encoding )
+{
+	const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+	const auto view = clientView( cl );
+	if( clientData == nullptr || view == nullptr )
+	{
+		return false;
+	}
+
+	const auto encoder = findEncoder( view->backend->server(), encoding );
+	if( encoder == nullptr )
+	{
+		return false;
+	}
+
+	// libvncserver counts a SetEncodings message before processing its encodings,
+	// so a changed count marks the first plugin encoding of a new message
+	const auto setEncodingsCount = rfbStatGetMessageCountRcvd( cl, rfbSetEncodings );
+	if( setEncodingsCount != clientData->announcedEncodings )
+	{
+		clientData->announcedEncoder = nullptr;
+		clientData->announcedEncodings = setEncodingsCount;
+	}
+
+	// libvncserver resets preferredEncoding for each SetEncodings message and
+	// sets it on the first built-in encoding, i.e. the client lists this one before
+	if( cl->preferredEncoding == -1 && clientData->announcedEncoder == nullptr )
+	{
+		clientData->announcedEncoder = encoder;
+	}
+
+	return true;
+}
+
+
+
+static Types::PixelFormat clientPixelFormat( const rfbPixelFormat& format )
+{
+	return { format.bitsPerPixel, format.depth,
+			 format.redMax, format.greenMax, format.blueMax,
+			 format.redShift, format.greenShift, format.blueShift };
+}
+
+
+
 static void handleClipboardText( char* str, int len, rfbClientPtr cl )
 {
 	str[len] = '\0';
 
-	const auto server = reinterpret_cast<Core::Server *>( cl->screen->screenData );
-	if( server )
+	const auto view = clientView( cl );
+	if( view )
 	{
-		server->clipboard()->setText( str );
+		view->backend->server()->clipboard()->setText( str );
 	}
 }
 
 
 static void handleKeyEvent( rfbBool down, rfbKeySym keySym, rfbClientPtr cl )
 {
-	const auto server = reinterpret_cast<Core::Server *>( cl->screen->screenData );
-	if( server )
+	const auto view = clientView( cl );
+	if( view )
 	{
+		const auto server = view->backend->server();
+		Core::Instrumentation::Timer timer( server->instrumentation(), Core::Instrumentation::Stage::InputInjection );
+
 		server->keyboard()->synthesizeKeyEvent( keySym, down );
+		server->notifyInputInjected();
 	}
 }
 
@@ -80,12 +318,25 @@ static void handlePointerEvent( int buttons, int x, int y, rfbClientPtr cl )
 {
 	using Button = Interfaces::PointingDevice::Button;
 
-	const auto server = reinterpret_cast<Core::Server *>( cl->screen->screenData );
-	if( server )
+	const auto view = clientView( cl );
+	if( view )
 	{
+		const auto server = view->backend->server();
+		Core::Instrumentation::Timer timer( server->instrumentation(), Core::Instrumentation::Stage::InputInjection );
+
 		if( cl->lastPtrX != x || cl->lastPtrY != y )
 		{
-			server->pointingDevice()->move( { x, y } );
+			if( view->mirror )
+			{
+				// center of the block the mirror pixel has been averaged from
+				const auto scale = view->mirror->scale();
+				server->pointingDevice()->move( { view->area.left() + x * scale + scale / 2,
+												  view->area.top() + y * scale + scale / 2 } );
+			}
+			else
+			{
+				server->pointingDevice()->move( { view->area.left() + x, view->area.top() + y } );
+			}
 		}
 
 		const auto handleButton = [buttons, cl, server]( auto buttonMask, Button button )
@@ -113,32 +364,54 @@ static void handlePointerEvent( int buttons, int x, int y, rfbClientPtr cl )
 		{
 			server->pointingDevice()->scrollDown();
 		}
+
+		server->notifyInputInjected();
 	}
 }
 
 
 
-LibVncServerBackend::~LibVncServerBackend()
+static int numberOfExtDesktopScreens( rfbClientPtr cl )
 {
-	shutdown();
+	return int( clientView( cl )->backend->screens().size() );
 }
 
 
 
-bool LibVncServerBackend::initialize( Core::Server* server )
+static rfbBool getExtDesktopScreen( int seqnumber, rfbExtDesktopScreen* extDesktopScreen, rfbClientPtr cl )
 {
-	m_server = server;
-
-	m_rfbScreen = rfbGetScreen( nullptr, nullptr,
-								   m_server->framebuffer()->size().width(),
-								   m_server->framebuffer()->size().height(),
-								   8, 3, 4 ); // TODO: honor FB/screen depth
+	const auto& screens = clientView( cl )->backend->screens();
 
-	if( m_rfbScreen == nullptr )
+	if( seqnumber < 0 || size_t(seqnumber) >= screens.size() )
 	{
 		return false;
 	}
 
+	const auto& screen = screens[size_t(seqnumber)];
+
+	extDesktopScreen->id = uint32_t(seqnumber + 1);
+	extDesktopScreen->x = uint16_t(screen.position().x());
+	extDesktopScreen->y = uint16_t(screen.position().y());
+	extDesktopScreen->width = uint16_t(screen.geometry().width());
+	extDesktopScreen->height = uint16_t(screen.geometry().height());
+	extDesktopScreen->flags = 0;
+
+	return true;
+}
+
+
+
+LibVncServerBackend::~LibVncServerBackend()
+{
+	shutdown();
+}
+
+
+
+bool LibVncServerBackend::initialize( Core::Server* server )
+{
+	m_server = server;
+
 	m_password = server->password();
 
 	if( m_password.size() > 0 )
@@ -146,61 +419,147 @@ bool LibVncServerBackend::initialize( Core::Server* server )
 		m_passwords[0] = m_password.c_str();
 	}
 
-	m_rfbScreen->desktopName = "AnyVNC";
-	m_rfbScreen->frameBuffer = reinterpret_cast<char *>( m_server->framebuffer()->data() );
-	m_rfbScreen->port = m_server->port();
-	m_rfbScreen->kbdAddEvent = handleKeyEvent;
-	m_rfbScreen->ptrAddEvent = handlePointerEvent;
-	m_rfbScreen->newClientHook = handleNewClient;
-	m_rfbScreen->setXCutText = handleClipboardText;
-
-	m_rfbScreen->authPasswdData = m_passwords.data();
-	m_rfbScreen->passwordCheck = rfbCheckPasswordByList;
-
-	m_rfbScreen->serverFormat.redShift = 16;
-	m_rfbScreen->serverFormat.greenShift = 8;
-	m_rfbScreen->serverFormat.blueShift = 0;
+	m_screens = m_server->framebuffer()->availableScreens();
+	m_pixelFormat = m_server->framebuffer()->pixelFormat();
 
-	m_rfbScreen->serverFormat.redMax = 255;
-	m_rfbScreen->serverFormat.greenMax = 255;
-	m_rfbScreen->serverFormat.blueMax = 255;
+	const auto size = m_server->framebuffer()->size();
 
-	m_rfbScreen->serverFormat.trueColour = true;
-
-	m_rfbScreen->alwaysShared = true;
-	m_rfbScreen->handleEventsEagerly = true;
-	m_rfbScreen->deferUpdateTime = 5;
+	if( createView( -1, { 0, 0, size.width() - 1, size.height() - 1 }, m_server->port() ) == false )
+	{
+		return false;
+	}
 
-	m_rfbScreen->screenData = server;
+	if( m_server->screenPortsEnabled() )
+	{
+		for( size_t i = 0; i < m_screens.size(); ++i )
+		{
+			if( createView( int(i), m_screens[i].rectangle(), m_server->port() + 1 + int(i) ) == false )
+			{
+				return false;
+			}
+		}
+	}
 
-	rfbInitServer( m_rfbScreen );
+	if( m_server->scaledMirrorPort() > 0 )
+	{
+		const auto& scales = Core::Server::ScaledMirrorScales;
+		for( size_t i = 0; i < scales.size(); ++i )
+		{
+			if( createView( -1, { 0, 0, size.width() - 1, size.height() - 1 },
+							m_server->scaledMirrorPort() + int(i), scales[i] ) == false )
+			{
+				return false;
+			}
+		}
+	}
 
-	rfbMarkRectAsModified( m_rfbScreen, 0, 0, m_rfbScreen->width, m_rfbScreen->height );
+	registerEncoders();
 
 	return true;
 }
 
 
 
-bool LibVncServerBackend::handleFramebufferUpdate()
+bool LibVncServerBackend::handleFramebufferUpdate( const Interfaces::Framebuffer::Update& update )
 {
 	bool modified = false;
 
-	const auto updateFlags = m_server->framebuffer()->update( [this, &modified]( Types::Rectangle rect ) {
-		rfbMarkRectAsModified( m_rfbScreen, rect.left(), rect.top(), rect.right()+1, rect.bottom()+1 );
+	if( update.flags & Interfaces::Framebuffer::UpdateFlag::SizeChanged )
+	{
+		reconfigure();
+		modified = true;
+	}
+	else if( update.flags & Interfaces::Framebuffer::UpdateFlag::ScreenLayoutChanged )
+	{
+		updateScreens( update.screens );
 		modified = true;
-	} );
+	}
+
+	// cursor changes are sent through pseudo encodings without touching the framebuffer
+	if( update.flags & Interfaces::Framebuffer::UpdateFlag::CursorShapeChanged )
+	{
+		m_cursorShape = update.cursorShape;
+		for( const auto& view : m_views )
+		{
+			// mirrors keep libvncserver's default cursor as full size shapes would be out of proportion
+			if( view->mirror == nullptr )
+			{
+				rfbSetCursor( view->rfbScreen, createCursor( m_cursorShape.get() ) );
+			}
+		}
+	}
 
-	if( updateFlags & Interfaces::Framebuffer::UpdateFlag::SizeChanged )
+	if( update.flags & Interfaces::Framebuffer::UpdateFlag::CursorMoved )
 	{
-		rfbClientPtr cl;
-		auto iterator = rfbGetClientIterator( m_rfbScreen );
-		while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+		for( const auto& view : m_views )
 		{
-			cl->newFBSizePending = 1;
+			setCursorPosition( view.get(), update.cursorPosition );
 		}
+	}
 
-		modified = true;
+	// size and layout changes mark all views as modified
+	const auto allViewsModified = modified;
+
+	for( const auto& view : m_views )
+	{
+		const auto& area = view->area;
+		bool viewModified = allViewsModified;
+
+		if( view->mirror )
+		{
+			if( updateScaledView( view.get(), update ) || viewModified )
+			{
+				markClientsDamaged( view->rfbScreen, update.captureTime );
+				modified = true;
+			}
+			continue;
+		}
+
+		// serve clients from the snapshot which belongs to this update
+		view->rfbScreen->frameBuffer = viewFramebuffer( view.get(), area );
+
+		// moves have to be scheduled in order and before marking damage as
+		// libvncserver moves already modified regions along with copied ones
+		for( const auto& move : update.moves )
+		{
+			const auto destination = move.destination().intersected( area );
+			if( destination.isEmpty() )
+			{
+				continue;
+			}
+
+			const auto source = move.source();
+			if( destination == move.destination() &&
+				source.intersected( area ) == source )
+			{
+				rfbScheduleCopyRect( view->rfbScreen,
+									 destination.left() - area.left(), destination.top() - area.top(),
+									 destination.right() + 1 - area.left(), destination.bottom() + 1 - area.top(),
+									 move.dx(), move.dy() );
+			}
+			else
+			{
+				// the source is not visible in this view
+				rfbMarkRectAsModified( view->rfbScreen,
+									   destination.left() - area.left(), destination.top() - area.top(),
+									   destination.right() + 1 - area.left(), destination.bottom() + 1 - area.top() );
+			}
+
+			viewModified = true;
+		}
+
+		const auto viewDamage = update.damage.intersected( area ).translated( -area.left(), -area.top() );
+		if( viewDamage.isEmpty() == false )
+		{
+			markRegionModified( view->rfbScreen, viewDamage );
+			viewModified = true;
+		}
+
+		if( viewModified )
+		{
+			markClientsDamaged( view->rfbScreen, update.captureTime );
+			modified = true;
+		}
 	}
 
 	return modified;
@@ -208,19 +567,56 @@ bool LibVncServerBackend::handleFramebufferUpdate()
 
 
 
+bool LibVncServerBackend::reconfigure()
+{
+	m_screens = m_server->framebuffer()->availableScreens();
+	m_pixelFormat = m_server->framebuffer()->pixelFormat();
+
+	const auto size = m_server->framebuffer()->size();
+	const Types::Rectangle framebufferArea{ 0, 0, size.width() - 1, size.height() - 1 };
+
+	// hand new framebuffer memory and geometry to all views while keeping clients connected
+	for( const auto& view : m_views )
+	{
+		if( view->screenIndex >= 0 && size_t(view->screenIndex) < m_screens.size() )
+		{
+			setViewArea( view.get(), m_screens[size_t(view->screenIndex)].rectangle() );
+		}
+		else
+		{
+			setViewArea( view.get(), framebufferArea );
+		}
+	}
+
+	return true;
+}
+
+
+
 bool LibVncServerBackend::hasConnectedClients() const
 {
-	return m_rfbScreen->clientHead != nullptr;
+	for( const auto& view : m_views )
+	{
+		if( view->rfbScreen->clientHead != nullptr )
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 
 bool LibVncServerBackend::hasPendingClientUpdateRequests() const
 {
-	for( auto clientPtr = m_rfbScreen->clientHead; clientPtr != nullptr; clientPtr = clientPtr->next )
+	for( const auto& view : m_views )
 	{
-		if( sraRgnEmpty( clientPtr->requestedRegion ) == false )
+		for( auto clientPtr = view->rfbScreen->clientHead; clientPtr != nullptr; clientPtr = clientPtr->next )
 		{
-			return true;
+			if( sraRgnEmpty( clientPtr->requestedRegion ) == false )
+			{
+				return true;
+			}
 		}
 	}
 
@@ -229,24 +625,776 @@ bool LibVncServerBackend::hasPendingClientUpdateRequests() const
 
 
 
-bool LibVncServerBackend::processEvents( int timeout )
+size_t LibVncServerBackend::pendingClientUpdates() const
 {
-	return rfbProcessEvents( m_rfbScreen, long(timeout) * MicroSecondsPerMilliSecond );
+	size_t count = 0;
+
+	for( const auto& view : m_views )
+	{
+		for( auto clientPtr = view->rfbScreen->clientHead; clientPtr != nullptr; clientPtr = clientPtr->next )
+		{
+			if( sraRgnEmpty( clientPtr->modifiedRegion ) == false )
+			{
+				++count;
+			}
+		}
+	}
+
+	return count;
 }
 
 
 
-bool LibVncServerBackend::shutdown()
+Types::Rectangle LibVncServerBackend::viewedArea() const
+{
+	Types::Rectangle area;
+
+	for( const auto& view : m_views )
+	{
+		if( view->rfbScreen->clientHead != nullptr )
+		{
+			area = area.united( view->area );
+		}
+	}
+
+	return area;
+}
+
+
+
+bool LibVncServerBackend::waitForEvents( int timeout, Types::EventHandle damageEvent )
+{
+	bool damaged = false;
+
+	waitForSockets( timeout, damageEvent, &damaged );
+
+	return damaged;
+}
+
+
+
+void LibVncServerBackend::collectEventHandles( std::vector<Types::EventHandle>* handles ) const
+{
+	for( const auto& view : m_views )
+	{
+#ifdef WIN32
+		if( view->socketEvent != WSA_INVALID_EVENT )
+		{
+			selectSocketEvents( view.get() );
+			handles->push_back( view->socketEvent );
+		}
+#else
+		for( int fd = 0; fd <= view->rfbScreen->maxFd; ++fd )
+		{
+			if( FD_ISSET( fd, &view->rfbScreen->allFds ) )
+			{
+				handles->push_back( fd );
+			}
+		}
+#endif
+	}
+}
+
+
+
+bool LibVncServerBackend::waitForSockets( int timeout, Types::EventHandle damageEvent, bool* damaged ) const
 {
-	if( m_rfbScreen )
+#ifdef WIN32
+	std::vector<HANDLE> handles;
+	collectEventHandles( &handles );
+
+	if( damageEvent != Types::InvalidEventHandle )
 	{
-		rfbShutdownServer( m_rfbScreen, true );
-		rfbScreenCleanup( m_rfbScreen );
+		handles.push_back( damageEvent );
+	}
 
-		m_rfbScreen = nullptr;
+	if( handles.empty() )
+	{
+		*damaged = false;
+		return false;
 	}
 
-	return true;
+	const auto result = WaitForMultipleObjects( DWORD( handles.size() ), handles.data(), FALSE,
+												DWORD( std::max( timeout, 0 ) ) );
+
+	*damaged = damageEvent != Types::InvalidEventHandle &&
+			WaitForSingleObject( damageEvent, 0 ) == WAIT_OBJECT_0;
+
+	return result < WAIT_OBJECT_0 + handles.size() || *damaged;
+#else
+	fd_set fds;
+	FD_ZERO( &fds );
+
+	int maxFd = -1;
+
+	for( const auto& view : m_views )
+	{
+		for( int fd = 0; fd <= view->rfbScreen->maxFd; ++fd )
+		{
+			if( FD_ISSET( fd, &view->rfbScreen->allFds ) )
+			{
+				FD_SET( fd, &fds );
+			}
+		}
+
+		maxFd = std::max( maxFd, view->rfbScreen->maxFd );
+	}
+
+	if( damageEvent != Types::InvalidEventHandle )
+	{
+		FD_SET( damageEvent, &fds );
+		maxFd = std::max( maxFd, damageEvent );
+	}
+
+	timeval tv{ timeout / 1000, ( timeout % 1000 ) * MicroSecondsPerMilliSecond };
+
+	const auto result = select( maxFd + 1, &fds, nullptr, nullptr, &tv );
+
+	*damaged = result > 0 &&
+			damageEvent != Types::InvalidEventHandle &&
+			FD_ISSET( damageEvent, &fds );
+
+	return result > 0;
+#endif
+}
+
+
+
+bool LibVncServerBackend::processInputEvents()
+{
+	bool processed = false;
+
+	for( const auto& view : m_views )
+	{
+		// only reads client messages (and accepts new connections) - updates are sent in processEvents()
+		processed |= rfbCheckFds( view->rfbScreen, 0 ) > 0;
+	}
+
+	return processed;
+}
+
+
+
+bool LibVncServerBackend::processEvents( int timeout )
+{
+	bool updatesPending = false;
+
+	for( const auto& view : m_views )
+	{
+		// requests arriving within rfbProcessEvents() are served with built-in
+		// encodings which clients have to support anyway
+		sendEncodedUpdates( view.get() );
+		updatesPending |= rfbProcessEvents( view->rfbScreen, long(timeout) * MicroSecondsPerMilliSecond );
+	}
+
+	return updatesPending;
+}
+
+
+
+bool LibVncServerBackend::shutdown()
+{
+	for( const auto& view : m_views )
+	{
+		rfbShutdownServer( view->rfbScreen, true );
+		rfbScreenCleanup( view->rfbScreen );
+#ifdef WIN32
+		if( view->socketEvent != WSA_INVALID_EVENT )
+		{
+			WSACloseEvent( view->socketEvent );
+		}
+#endif
+	}
+
+	m_views.clear();
+
+	return true;
+}
+
+
+
+void LibVncServerBackend::registerEncoders() const
+{
+	const auto& encoders = m_server->encoders();
+	if( encoders.empty() )
+	{
+		return;
+	}
+
+	// libvncserver manages extensions globally, so all sessions share the
+	// encodings of the first one which uses the same plugins anyway
+	static std::vector<int> encodings;
+	static rfbProtocolExtension extension{};
+
+	if( encodings.empty() )
+	{
+		for( const auto encoder : encoders )
+		{
+			encodings.push_back( encoder->encoding() );
+		}
+		encodings.push_back( 0 );
+
+		// only asked about encodings which libvncserver doesn't implement itself -
+		// replacements of built-in ones are selected via preferredEncoding instead
+		extension.pseudoEncodings = encodings.data();
+		extension.enablePseudoEncoding = enableEncoder;
+
+		rfbRegisterProtocolExtension( &extension );
+	}
+}
+
+
+
+void LibVncServerBackend::sendEncodedUpdates( LibVncServerView* view )
+{
+	if( m_server->encoders().empty() )
+	{
+		return;
+	}
+
+	rfbClientPtr cl;
+	auto iterator = rfbGetClientIterator( view->rfbScreen );
+	while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+	{
+		const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+		if( clientData == nullptr || sraRgnEmpty( cl->requestedRegion ) )
+		{
+			continue;
+		}
+
+		if( clientData->encoderBackoff > 0 )
+		{
+			--clientData->encoderBackoff;
+			continue;
+		}
+
+		// the client's latest SetEncodings message did not list any plugin encoding
+		const auto setEncodingsCount = rfbStatGetMessageCountRcvd( cl, rfbSetEncodings );
+		if( setEncodingsCount != clientData->announcedEncodings )
+		{
+			clientData->announcedEncoder = nullptr;
+			clientData->announcedEncodings = setEncodingsCount;
+		}
+
+		auto encoder = clientData->announcedEncoder;
+		if( encoder == nullptr )
+		{
+			encoder = findEncoder( m_server, cl->preferredEncoding );
+		}
+
+		if( encoder != clientData->encoder )
+		{
+			clientData->encoder = encoder;
+			clientData->encoderState = encoder ? encoder->createClientState() : nullptr;
+		}
+
+		// leave pseudo encodings and cursors drawn into the framebuffer to libvncserver
+		if( encoder == nullptr ||
+			cl->format.trueColour == false ||
+			cl->newFBSizePending ||
+			cl->enableCursorShapeUpdates == false ||
+			cl->cursorWasChanged ||
+			( cl->enableCursorPosUpdates && cl->cursorWasMoved ) )
+		{
+			continue;
+		}
+
+		if( sendEncodedUpdate( view, cl, encoder ) )
+		{
+			clientData->encoderFailures = 0;
+		}
+		else
+		{
+			// libvncserver sends this update - back off exponentially if the encoder keeps failing
+			++clientData->encoderFailures;
+			clientData->encoderBackoff = std::min( 1 << std::min( clientData->encoderFailures - 1, 30 ),
+												   MaxEncoderBackoff + 1 ) - 1;
+		}
+	}
+	rfbReleaseClientIterator( iterator );
+}
+
+
+
+bool LibVncServerBackend::sendEncodedUpdate( LibVncServerView* view, rfbClientPtr cl, Interfaces::Encoder* encoder )
+{
+	// moves are sent as pixels of the current snapshot instead of CopyRect
+	sraRgnOr( cl->modifiedRegion, cl->copyRegion );
+	sraRgnMakeEmpty( cl->copyRegion );
+
+	auto updateRegion = sraRgnCreateRgn( cl->modifiedRegion );
+	sraRgnAnd( updateRegion, cl->requestedRegion );
+
+	if( sraRgnEmpty( updateRegion ) )
+	{
+		sraRgnDestroy( updateRegion );
+		return true;
+	}
+
+	// measure the encoding as well, just like for updates sent by libvncserver
+	handleUpdateStart( cl );
+
+	// split the update into tiles if the encoder supports encoding them concurrently
+	const auto tileSize = encoder->tileSize();
+	const auto tileWidth = tileSize.isValid() && tileSize.isNull() == false ? tileSize.width() : std::numeric_limits<int>::max();
+	const auto tileHeight = tileSize.isValid() && tileSize.isNull() == false ? tileSize.height() : std::numeric_limits<int>::max();
+
+	std::vector<EncodedTile> tiles;
+
+	sraRect rect;
+	auto rects = sraRgnGetIterator( updateRegion );
+	while( sraRgnIteratorNext( rects, &rect ) )
+	{
+		for( int y = rect.y1, height = 0; y < rect.y2; y += height )
+		{
+			height = std::min( tileHeight, rect.y2 - y );
+			for( int x = rect.x1, width = 0; x < rect.x2; x += width )
+			{
+				width = std::min( tileWidth, rect.x2 - x );
+				tiles.push_back( { { x, y, x + width - 1, y + height - 1 }, {} } );
+			}
+		}
+	}
+	sraRgnReleaseIterator( rects );
+
+	if( encodeTiles( view, cl, encoder, &tiles ) == false )
+	{
+		// libvncserver sends the region with its built-in encodings instead
+		sraRgnDestroy( updateRegion );
+		return false;
+	}
+
+	// tiles are sent in order no matter when they have been encoded - updates
+	// with more tiles than fit into one message are sent as several messages
+	std::vector<uint8_t> message;
+
+	for( size_t first = 0; first < tiles.size(); first += MaxRectsPerUpdate )
+	{
+		const auto last = std::min( first + MaxRectsPerUpdate, tiles.size() );
+
+		rfbFramebufferUpdateMsg updateHeader{};
+		updateHeader.type = rfbFramebufferUpdate;
+		updateHeader.nRects = Swap16IfLE( uint16_t(last - first) );
+
+		const auto updateHeaderData = reinterpret_cast<const uint8_t *>( &updateHeader );
+		message.assign( updateHeaderData, updateHeaderData + sz_rfbFramebufferUpdateMsg );
+
+		int rawBytes = 0;
+
+		for( auto i = first; i < last; ++i )
+		{
+			const auto& tile = tiles[i];
+
+			rfbFramebufferUpdateRectHeader header;
+			header.r.x = Swap16IfLE( uint16_t(tile.rect.left()) );
+			header.r.y = Swap16IfLE( uint16_t(tile.rect.top()) );
+			header.r.w = Swap16IfLE( uint16_t(tile.rect.width()) );
+			header.r.h = Swap16IfLE( uint16_t(tile.rect.height()) );
+			header.encoding = Swap32IfLE( uint32_t(encoder->encoding()) );
+
+			const auto headerData = reinterpret_cast<const uint8_t *>( &header );
+			message.insert( message.end(), headerData, headerData + sz_rfbFramebufferUpdateRectHeader );
+			message.insert( message.end(), tile.data.begin(), tile.data.end() );
+
+			rawBytes += tile.rect.width() * tile.rect.height() * cl->format.bitsPerPixel / 8;
+		}
+
+		bool written = false;
+		{
+			Core::Instrumentation::Timer timer( m_server->instrumentation(), Core::Instrumentation::Stage::SocketWrite );
+			written = rfbWriteExact( cl, reinterpret_cast<const char *>( message.data() ), int(message.size()) ) >= 0;
+		}
+
+		if( written == false )
+		{
+			rfbCloseClient( cl );
+			sraRgnDestroy( updateRegion );
+			return true;
+		}
+
+		rfbStatRecordEncodingSent( cl, uint32_t(encoder->encoding()), int(message.size()), rawBytes );
+	}
+
+	sraRgnSubtract( cl->modifiedRegion, updateRegion );
+	sraRgnMakeEmpty( cl->requestedRegion );
+	sraRgnDestroy( updateRegion );
+
+	handleUpdateFinished( cl, true );
+
+	return true;
+}
+
+
+
+bool LibVncServerBackend::createView( int screenIndex, Types::Rectangle area, int port, int scale )
+{
+	auto view = std::make_unique<LibVncServerView>();
+	view->backend = this;
+	view->area = area;
+	view->screenIndex = screenIndex;
+
+	Types::Size size{ area.width(), area.height() };
+
+	if( scale > 1 )
+	{
+		view->mirror = std::make_unique<Core::ScaledMirror>( scale );
+		view->mirror->update( *m_server->snapshot(), m_pixelFormat.bytesPerPixel(), {} );
+		size = view->mirror->size();
+		view->desktopName = std::string("AnyVNC (1/") + std::to_string(scale) + ")";
+	}
+	else
+	{
+		view->desktopName = screenIndex < 0 ? std::string("AnyVNC") :
+											  std::string("AnyVNC (screen ") + std::to_string(screenIndex+1) + ")";
+	}
+
+	auto rfbScreen = rfbGetScreen( nullptr, nullptr,
+								   size.width(), size.height(),
+								   m_pixelFormat.bitsPerSample(),
+								   m_pixelFormat.samplesPerPixel(),
+								   m_pixelFormat.bytesPerPixel() );
+
+	if( rfbScreen == nullptr )
+	{
+		return false;
+	}
+
+	rfbScreen->desktopName = view->desktopName.c_str();
+	rfbScreen->frameBuffer = viewFramebuffer( view.get(), area );
+	rfbScreen->paddedWidthInBytes = viewBytesPerLine( view.get() );
+	rfbScreen->port = port;
+	rfbScreen->kbdAddEvent = handleKeyEvent;
+	rfbScreen->ptrAddEvent = handlePointerEvent;
+	rfbScreen->newClientHook = handleNewClient;
+	rfbScreen->setXCutText = handleClipboardText;
+	rfbScreen->displayHook = handleUpdateStart;
+	rfbScreen->displayFinishedHook = handleUpdateFinished;
+
+	if( screenIndex < 0 && view->mirror == nullptr )
+	{
+		// announce the layout of all screens through ExtendedDesktopSize
+		rfbScreen->numberOfExtDesktopScreensHook = numberOfExtDesktopScreens;
+		rfbScreen->getExtDesktopScreenHook = getExtDesktopScreen;
+	}
+
+	rfbScreen->authPasswdData = m_passwords.data();
+	rfbScreen->passwordCheck = rfbCheckPasswordByList;
+
+	rfbScreen->alwaysShared = true;
+	rfbScreen->handleEventsEagerly = true;
+	// updates are paced by the server's frame rate governor already
+	rfbScreen->deferUpdateTime = 0;
+
+	rfbScreen->screenData = view.get();
+
+	view->rfbScreen = rfbScreen;
+	applyPixelFormat( view.get() );
+
+	rfbInitServer( rfbScreen );
+
+#ifdef WIN32
+	// WinSock is initialized by rfbInitServer()
+	view->socketEvent = WSACreateEvent();
+#endif
+
+	rfbMarkRectAsModified( rfbScreen, 0, 0, rfbScreen->width, rfbScreen->height );
+
+	m_views.push_back( std::move(view) );
+
+	return true;
+}
+
+
+
+void LibVncServerBackend::updateScreens( const Types::Screens& screens )
+{
+	m_screens = screens;
+
+	for( const auto& view : m_views )
+	{
+		if( view->mirror )
+		{
+			continue;
+		}
+
+		if( view->screenIndex < 0 )
+		{
+			// let clients query the new layout via ExtendedDesktopSize
+			rfbClientPtr cl;
+			auto iterator = rfbGetClientIterator( view->rfbScreen );
+			while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+			{
+				cl->newFBSizePending = 1;
+			}
+			rfbReleaseClientIterator( iterator );
+		}
+		else if( size_t(view->screenIndex) < m_screens.size() )
+		{
+			setViewArea( view.get(), m_screens[size_t(view->screenIndex)].rectangle() );
+		}
+	}
+}
+
+
+
+void LibVncServerBackend::setViewArea( LibVncServerView* view, Types::Rectangle area )
+{
+	Types::Size size{ area.width(), area.height() };
+
+	if( view->mirror )
+	{
+		// refresh completely as the pixel format may have changed as well
+		const auto snapshot = m_server->snapshot();
+		view->mirror->update( *snapshot, m_pixelFormat.bytesPerPixel(),
+							  Types::Region( { 0, 0, snapshot->size().width() - 1, snapshot->size().height() - 1 } ) );
+		size = view->mirror->size();
+	}
+
+	if( size.width() == view->rfbScreen->width && size.height() == view->rfbScreen->height &&
+		m_pixelFormat == view->pixelFormat )
+	{
+		view->rfbScreen->frameBuffer = viewFramebuffer( view, area );
+		view->rfbScreen->paddedWidthInBytes = viewBytesPerLine( view );
+		rfbMarkRectAsModified( view->rfbScreen, 0, 0, view->rfbScreen->width, view->rfbScreen->height );
+	}
+	else
+	{
+		// resizes the screen and notifies all clients via NewFBSize/ExtendedDesktopSize
+		rfbNewFramebuffer( view->rfbScreen, viewFramebuffer( view, area ), size.width(), size.height(),
+						   m_pixelFormat.bitsPerSample(), m_pixelFormat.samplesPerPixel(), m_pixelFormat.bytesPerPixel() );
+		view->rfbScreen->paddedWidthInBytes = viewBytesPerLine( view );
+
+		// rfbNewFramebuffer() resets the server format to libvncserver's defaults
+		applyPixelFormat( view );
+	}
+
+	view->area = area;
+}
+
+
+
+bool LibVncServerBackend::updateScaledView( LibVncServerView* view, const Interfaces::Framebuffer::Update& update ) const
+{
+	// moves can't be applied to the mirror exactly, so moved areas are refreshed like damage
+	auto damage = update.damage;
+	for( const auto& move : update.moves )
+	{
+		damage.add( move.destination() );
+	}
+
+	if( damage.isEmpty() )
+	{
+		return false;
+	}
+
+	const auto scaledDamage = view->mirror->update( *m_server->snapshot(), m_pixelFormat.bytesPerPixel(), damage );
+
+	// the mirror reallocates its memory if the geometry has changed
+	view->rfbScreen->frameBuffer = viewFramebuffer( view, view->area );
+
+	if( scaledDamage.isEmpty() )
+	{
+		return false;
+	}
+
+	markRegionModified( view->rfbScreen, scaledDamage );
+
+	return true;
+}
+
+
+
+bool LibVncServerBackend::encodeTiles( LibVncServerView* view, rfbClientPtr cl, Interfaces::Encoder* encoder,
+										std::vector<EncodedTile>* tiles )
+{
+	const auto clientData = reinterpret_cast<LibVncClientData *>( cl->clientData );
+
+	const auto& image = view->mirror ? view->mirror->image() : *m_server->snapshot();
+	const auto offsetX = view->mirror ? 0 : view->area.left();
+	const auto offsetY = view->mirror ? 0 : view->area.top();
+	const Interfaces::Encoder::TargetFormat targetFormat{ clientPixelFormat( cl->format ), cl->format.bigEndian != 0 };
+
+	const auto encodeTile = [&]( size_t index ) {
+		auto& tile = (*tiles)[index];
+		tile.encoded = encoder->encode( image, m_pixelFormat, tile.rect.translated( offsetX, offsetY ),
+										targetFormat, clientData->encoderState.get(), &tile.data );
+	};
+
+	if( tiles->size() > 1 && encoder->tileSize().isValid() )
+	{
+		// shared by the sessions of all backends in the process so that hosting
+		// many sessions doesn't multiply the number of encoding threads
+		static Core::WorkerPool encoderPool;
+
+		// threads keep picking the next tile so that expensive tiles don't stall the others
+		encoderPool.runParallel( tiles->size(), encodeTile );
+	}
+	else
+	{
+		for( size_t i = 0; i < tiles->size(); ++i )
+		{
+			encodeTile( i );
+		}
+	}
+
+	return std::all_of( tiles->begin(), tiles->end(), []( const EncodedTile& tile ) { return tile.encoded; } );
+}
+
+
+
+void LibVncServerBackend::applyPixelFormat( LibVncServerView* view ) const
+{
+	auto& format = view->rfbScreen->serverFormat;
+
+	// serve the framebuffer's pixels as they are - libvncserver translates
+	// them to each client's format while encoding anyway
+	format.bitsPerPixel = uint8_t(m_pixelFormat.bitsPerPixel());
+	format.depth = uint8_t(m_pixelFormat.depth());
+	format.redMax = uint16_t(m_pixelFormat.redMax());
+	format.greenMax = uint16_t(m_pixelFormat.greenMax());
+	format.blueMax = uint16_t(m_pixelFormat.blueMax());
+	format.redShift = uint8_t(m_pixelFormat.redShift());
+	format.greenShift = uint8_t(m_pixelFormat.greenShift());
+	format.blueShift = uint8_t(m_pixelFormat.blueShift());
+	format.trueColour = true;
+
+	view->pixelFormat = m_pixelFormat;
+
+	// rich cursor pixels are stored in the server format as well
+	if( m_cursorShape && view->mirror == nullptr )
+	{
+		rfbSetCursor( view->rfbScreen, createCursor( m_cursorShape.get() ) );
+	}
+
+	// translation tables of connected clients refer to the previous format
+	rfbClientPtr cl;
+	auto iterator = rfbGetClientIterator( view->rfbScreen );
+	while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+	{
+		rfbSetTranslateFunction( cl );
+	}
+	rfbReleaseClientIterator( iterator );
+}
+
+
+
+rfbCursorPtr LibVncServerBackend::createCursor( const Types::Cursor* shape ) const
+{
+	if( shape == nullptr || shape->size().isNull() )
+	{
+		return nullptr;
+	}
+
+	const auto width = shape->size().width();
+	const auto height = shape->size().height();
+	const auto bytesPerPixel = size_t(m_pixelFormat.bytesPerPixel());
+	const auto maskBytesPerLine = size_t( ( width + 7 ) / 8 );
+	const auto maskSize = maskBytesPerLine * size_t(height);
+
+	// allocated with malloc() as rfbSetCursor() and rfbScreenCleanup() release it with free()
+	auto cursor = static_cast<rfbCursorPtr>( calloc( 1, sizeof(rfbCursor) ) );
+	cursor->width = uint16_t(width);
+	cursor->height = uint16_t(height);
+	cursor->xhot = uint16_t(shape->hotSpot().x());
+	cursor->yhot = uint16_t(shape->hotSpot().y());
+	cursor->source = static_cast<unsigned char *>( calloc( maskSize, 1 ) );
+	cursor->mask = static_cast<unsigned char *>( calloc( maskSize, 1 ) );
+	cursor->richSource = static_cast<unsigned char *>( calloc( size_t(width) * size_t(height), bytesPerPixel ) );
+	cursor->cleanup = true;
+	cursor->cleanupSource = true;
+	cursor->cleanupMask = true;
+	cursor->cleanupRichSource = true;
+
+	// two-colored fallback for clients without RichCursor support
+	cursor->foreRed = cursor->foreGreen = cursor->foreBlue = 0;
+	cursor->backRed = cursor->backGreen = cursor->backBlue = 0xffff;
+
+	const auto scale = []( uint32_t value, int max ) {
+		return ( value * uint32_t(max) + 127 ) / 255;
+	};
+
+	for( int y = 0; y < height; ++y )
+	{
+		for( int x = 0; x < width; ++x )
+		{
+			const auto argb = shape->pixel( x, y );
+			const auto red = ( argb >> 16 ) & 0xff;
+			const auto green = ( argb >> 8 ) & 0xff;
+			const auto blue = argb & 0xff;
+			const auto bit = uint8_t( 0x80 >> ( x % 8 ) );
+			const auto maskOffset = size_t(y) * maskBytesPerLine + size_t(x / 8);
+
+			if( ( argb >> 24 ) >= 0x80 )
+			{
+				cursor->mask[maskOffset] |= bit;
+			}
+
+			if( red + green + blue < 3 * 0x80 )
+			{
+				cursor->source[maskOffset] |= bit;
+			}
+
+			// rich cursor pixels have to be in the server's pixel format
+			const auto pixel = scale( red, m_pixelFormat.redMax() ) << m_pixelFormat.redShift() |
+							   scale( green, m_pixelFormat.greenMax() ) << m_pixelFormat.greenShift() |
+							   scale( blue, m_pixelFormat.blueMax() ) << m_pixelFormat.blueShift();
+			auto destination = cursor->richSource + ( size_t(y) * size_t(width) + size_t(x) ) * bytesPerPixel;
+
+			switch( bytesPerPixel )
+			{
+			case 1: *destination = uint8_t(pixel); break;
+			case 2: { const auto value = uint16_t(pixel); memcpy( destination, &value, sizeof(value) ); break; }
+			default: memcpy( destination, &pixel, std::min( bytesPerPixel, sizeof(pixel) ) ); break;
+			}
+		}
+	}
+
+	return cursor;
+}
+
+
+
+void LibVncServerBackend::setCursorPosition( LibVncServerView* view, Types::Point position ) const
+{
+	const auto& area = view->area;
+	const auto scale = view->mirror ? view->mirror->scale() : 1;
+
+	view->rfbScreen->cursorX = std::max( 0, std::min( position.x(), area.right() ) - area.left() ) / scale;
+	view->rfbScreen->cursorY = std::max( 0, std::min( position.y(), area.bottom() ) - area.top() ) / scale;
+
+	// sent via PointerPos to clients supporting it, drawn into updates for all others
+	rfbClientPtr cl;
+	auto iterator = rfbGetClientIterator( view->rfbScreen );
+	while( ( cl = rfbClientIteratorNext(iterator) ) != nullptr )
+	{
+		cl->cursorWasMoved = true;
+	}
+	rfbReleaseClientIterator( iterator );
+}
+
+
+
+char* LibVncServerBackend::viewFramebuffer( const LibVncServerView* view, Types::Rectangle area ) const
+{
+	if( view->mirror )
+	{
+		// only modified on this thread in between sending updates
+		return reinterpret_cast<char *>( view->mirror->data() );
+	}
+
+	// never point libvncserver to the framebuffer plugin's memory directly as
+	// it may be written by the capture stage while updates are being encoded
+	const auto snapshot = m_server->snapshot();
+
+	return reinterpret_cast<char *>( const_cast<uint8_t *>( snapshot->data() ) ) +
+			area.top() * snapshot->bytesPerLine() + area.left() * m_pixelFormat.bytesPerPixel();
+}
+
+
+
+int LibVncServerBackend::viewBytesPerLine( const LibVncServerView* view ) const
+{
+	return view->mirror ? view->mirror->bytesPerLine() : m_server->snapshot()->bytesPerLine();
 }
 
 }
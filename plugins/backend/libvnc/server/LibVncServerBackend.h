@@ -25,16 +25,23 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <vector>
 
 extern "C" {
 #include <rfb/rfb.h>
 }
 
+#include "libanyvnc/interfaces/Encoder.h"
 #include "libanyvnc/interfaces/ServerBackend.h"
+#include "libanyvnc/types/Cursor.h"
 
 namespace AnyVnc
 {
 
+struct LibVncServerView;
+struct EncodedTile;
+
 // clazy:excludeall=copyable-polymorphic
 
 class LibVncServerBackend : public Interfaces::ServerBackend
@@ -80,17 +87,57 @@ public:
 
 	bool initialize( Core::Server* server ) override;
 
-	bool handleFramebufferUpdate() override;
+	bool handleFramebufferUpdate( const Interfaces::Framebuffer::Update& update ) override;
+	bool reconfigure() override;
 	bool hasConnectedClients() const override;
 	bool hasPendingClientUpdateRequests() const override;
+	size_t pendingClientUpdates() const override;
+	Types::Rectangle viewedArea() const override;
+	bool waitForEvents( int timeout, Types::EventHandle damageEvent ) override;
+	void collectEventHandles( std::vector<Types::EventHandle>* handles ) const override;
+	bool processInputEvents() override;
 	bool processEvents( int timeout ) override;
 	bool shutdown() override;
 
+	Core::Server* server() const
+	{
+		return m_server;
+	}
+
+	const Types::Screens& screens() const
+	{
+		return m_screens;
+	}
+
 private:
 	static constexpr auto MicroSecondsPerMilliSecond = 1000;
+	// number of rectangles of a FramebufferUpdate message is 16 bit
+	static constexpr size_t MaxRectsPerUpdate = 0xffff;
+	// maximum number of updates sent by libvncserver after repeated plugin encoder failures
+	static constexpr auto MaxEncoderBackoff = 64;
+
+	bool waitForSockets( int timeout, Types::EventHandle damageEvent, bool* damaged ) const;
+	void registerEncoders() const;
+	void sendEncodedUpdates( LibVncServerView* view );
+	bool sendEncodedUpdate( LibVncServerView* view, rfbClientPtr cl, Interfaces::Encoder* encoder );
+	bool encodeTiles( LibVncServerView* view, rfbClientPtr cl, Interfaces::Encoder* encoder,
+					  std::vector<EncodedTile>* tiles );
+
+	bool createView( int screenIndex, Types::Rectangle area, int port, int scale = 1 );
+	void updateScreens( const Types::Screens& screens );
+	void setViewArea( LibVncServerView* view, Types::Rectangle area );
+	bool updateScaledView( LibVncServerView* view, const Interfaces::Framebuffer::Update& update ) const;
+	void applyPixelFormat( LibVncServerView* view ) const;
+	rfbCursorPtr createCursor( const Types::Cursor* shape ) const;
+	void setCursorPosition( LibVncServerView* view, Types::Point position ) const;
+	char* viewFramebuffer( const LibVncServerView* view, Types::Rectangle area ) const;
+	int viewBytesPerLine( const LibVncServerView* view ) const;
 
 	Core::Server* m_server{nullptr};
-	rfbScreenInfoPtr m_rfbScreen{nullptr};
+	std::vector<std::unique_ptr<LibVncServerView>> m_views;
+	Types::Screens m_screens;
+	Types::PixelFormat m_pixelFormat{Types::PixelFormat::xrgb8888()};
+	std::shared_ptr<const Types::Cursor> m_cursorShape;
 	std::string m_password;
 	std::array<const char *, 2> m_passwords{};
 
@@ -0,0 +1,305 @@
+/*
+ * TightEncoder.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <zlib.h>
+
+#include "TightEncoder.h"
+
+namespace AnyVnc
+{
+
+// deflate state of the calling thread which is reset for each tile instead of
+// allocating a new one every time
+class DeflateStream
+{
+public:
+	DeflateStream() = default;
+
+	~DeflateStream()
+	{
+		if( m_level >= 0 )
+		{
+			deflateEnd( &m_stream );
+		}
+	}
+
+	DeflateStream( const DeflateStream& ) = delete;
+	DeflateStream& operator=( const DeflateStream& ) = delete;
+
+	z_stream* reset( int level )
+	{
+		if( level != m_level )
+		{
+			if( m_level >= 0 )
+			{
+				deflateEnd( &m_stream );
+				m_level = -1;
+			}
+
+			if( deflateInit( &m_stream, level ) != Z_OK )
+			{
+				return nullptr;
+			}
+
+			m_level = level;
+		}
+		else if( deflateReset( &m_stream ) != Z_OK )
+		{
+			return nullptr;
+		}
+
+		return &m_stream;
+	}
+
+private:
+	z_stream m_stream{};
+	int m_level{-1};
+
+};
+
+
+
+static uint32_t readPixel( const uint8_t* data, int bytesPerPixel )
+{
+	switch( bytesPerPixel )
+	{
+	case 4:
+	{
+		uint32_t pixel;
+		memcpy( &pixel, data, sizeof(pixel) );
+		return pixel;
+	}
+	case 2:
+	{
+		uint16_t pixel;
+		memcpy( &pixel, data, sizeof(pixel) );
+		return pixel;
+	}
+	default:
+		break;
+	}
+
+	return *data;
+}
+
+
+
+static uint32_t convertSample( uint32_t pixel, int shift, int max, int targetMax )
+{
+	const auto sample = ( pixel >> uint32_t(shift) ) & uint32_t(max);
+	if( max == targetMax || max == 0 )
+	{
+		return sample;
+	}
+
+	return ( sample * uint32_t(targetMax) + uint32_t(max / 2) ) / uint32_t(max);
+}
+
+
+
+// TPIXEL - 24 bit colours are sent as three bytes in RGB order
+static bool isPackedFormat( const Interfaces::Encoder::TargetFormat& targetFormat )
+{
+	const auto& format = targetFormat.pixelFormat;
+
+	return format.bitsPerPixel() == 32 && format.depth() == 24 &&
+			format.redMax() == 0xff && format.greenMax() == 0xff && format.blueMax() == 0xff;
+}
+
+
+
+static void appendPixel( uint32_t pixel, const Types::PixelFormat& sourceFormat,
+						 const Interfaces::Encoder::TargetFormat& targetFormat, bool packed,
+						 std::vector<uint8_t>* output )
+{
+	const auto& format = targetFormat.pixelFormat;
+
+	const auto red = convertSample( pixel, sourceFormat.redShift(), sourceFormat.redMax(), format.redMax() );
+	const auto green = convertSample( pixel, sourceFormat.greenShift(), sourceFormat.greenMax(), format.greenMax() );
+	const auto blue = convertSample( pixel, sourceFormat.blueShift(), sourceFormat.blueMax(), format.blueMax() );
+
+	if( packed )
+	{
+		output->push_back( uint8_t(red) );
+		output->push_back( uint8_t(green) );
+		output->push_back( uint8_t(blue) );
+		return;
+	}
+
+	const auto value = ( red << uint32_t(format.redShift()) ) |
+					   ( green << uint32_t(format.greenShift()) ) |
+					   ( blue << uint32_t(format.blueShift()) );
+	const auto bytesPerPixel = format.bytesPerPixel();
+
+	for( int i = 0; i < bytesPerPixel; ++i )
+	{
+		const auto byteIndex = targetFormat.bigEndian ? bytesPerPixel - 1 - i : i;
+		output->push_back( uint8_t( value >> uint32_t( byteIndex * 8 ) ) );
+	}
+}
+
+
+
+bool TightEncoder::initialize( Core::Server* )
+{
+	const auto level = std::getenv( "ANYVNC_TIGHT_COMPRESSION" );
+	if( level )
+	{
+		m_compressionLevel = atoi( level );
+		if( m_compressionLevel < Z_NO_COMPRESSION || m_compressionLevel > Z_BEST_COMPRESSION )
+		{
+			std::cerr << "TightEncoder: invalid compression level " << level << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+bool TightEncoder::encode( const Types::Image& image, const Types::PixelFormat& sourceFormat,
+						   const Types::Rectangle& rect, const TargetFormat& targetFormat,
+						   ClientState*, std::vector<uint8_t>* output )
+{
+	const auto width = rect.width();
+	const auto height = rect.height();
+	const auto sourceBytesPerPixel = sourceFormat.bytesPerPixel();
+
+	if( width <= 0 || height <= 0 || width > MaximumRectWidth ||
+		rect.left() < 0 || rect.top() < 0 ||
+		rect.right() >= image.size().width() || rect.bottom() >= image.size().height() )
+	{
+		return false;
+	}
+
+	const auto firstPixel = readPixel( image.scanLine( rect.top() ) + rect.left() * sourceBytesPerPixel,
+									   sourceBytesPerPixel );
+
+	bool solid = true;
+	for( int y = rect.top(); solid && y <= rect.bottom(); ++y )
+	{
+		auto source = image.scanLine( y ) + rect.left() * sourceBytesPerPixel;
+		for( int x = 0; x < width; ++x, source += sourceBytesPerPixel )
+		{
+			if( readPixel( source, sourceBytesPerPixel ) != firstPixel )
+			{
+				solid = false;
+				break;
+			}
+		}
+	}
+
+	const auto packed = isPackedFormat( targetFormat );
+
+	if( solid )
+	{
+		output->push_back( ControlFill );
+		appendPixel( firstPixel, sourceFormat, targetFormat, packed, output );
+		return true;
+	}
+
+	std::vector<uint8_t> pixels;
+	pixels.reserve( size_t(width) * size_t(height) *
+					size_t( packed ? 3 : targetFormat.pixelFormat.bytesPerPixel() ) );
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		auto source = image.scanLine( y ) + rect.left() * sourceBytesPerPixel;
+		for( int x = 0; x < width; ++x, source += sourceBytesPerPixel )
+		{
+			appendPixel( readPixel( source, sourceBytesPerPixel ), sourceFormat, targetFormat, packed, &pixels );
+		}
+	}
+
+	if( pixels.size() < MinimumSizeToCompress )
+	{
+		output->push_back( 0 );
+		output->insert( output->end(), pixels.begin(), pixels.end() );
+		return true;
+	}
+
+	// basic compression with the copy filter on zlib stream 0
+	output->push_back( ControlResetStream0 );
+
+	return compress( pixels, output );
+}
+
+
+
+bool TightEncoder::compress( const std::vector<uint8_t>& data, std::vector<uint8_t>* output ) const
+{
+	static thread_local DeflateStream deflateStream;
+
+	auto stream = deflateStream.reset( m_compressionLevel );
+	if( stream == nullptr )
+	{
+		return false;
+	}
+
+	// deflateBound() covers Z_FINISH only, a sync flush adds an empty stored block
+	std::vector<uint8_t> compressed( deflateBound( stream, uLong(data.size()) ) + 16 );
+
+	stream->next_in = const_cast<Bytef *>( data.data() );
+	stream->avail_in = uInt(data.size());
+	stream->next_out = compressed.data();
+	stream->avail_out = uInt(compressed.size());
+
+	// the decoder inflates the data as part of a continuous stream, so it must not be finished
+	if( deflate( stream, Z_SYNC_FLUSH ) != Z_OK || stream->avail_in != 0 || stream->avail_out == 0 )
+	{
+		return false;
+	}
+
+	const auto compressedSize = compressed.size() - stream->avail_out;
+
+	appendCompactLength( compressedSize, output );
+	output->insert( output->end(), compressed.begin(), compressed.begin() + long(compressedSize) );
+
+	return true;
+}
+
+
+
+void TightEncoder::appendCompactLength( size_t length, std::vector<uint8_t>* output )
+{
+	// 7 bits per byte, the most significant bit flags another byte to follow
+	output->push_back( uint8_t( length & 0x7f ) | ( length > 0x7f ? 0x80 : 0 ) );
+	if( length > 0x7f )
+	{
+		output->push_back( uint8_t( ( length >> 7 ) & 0x7f ) | ( length > 0x3fff ? 0x80 : 0 ) );
+		if( length > 0x3fff )
+		{
+			output->push_back( uint8_t( length >> 14 ) );
+		}
+	}
+}
+
+}
+
+ANYVNC_EXPORT_PLUGIN(AnyVnc::TightEncoder)
@@ -0,0 +1,106 @@
+/*
+ * TightEncoder.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include "libanyvnc/interfaces/Encoder.h"
+
+namespace AnyVnc
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+// lossless Tight encoding using the fill and basic compression subencodings -
+// every tile resets its zlib stream so tiles are compressed independently and
+// can be encoded concurrently. The zlib level is read from
+// ANYVNC_TIGHT_COMPRESSION (0-9, defaults to 6).
+class TightEncoder : public Interfaces::Encoder
+{
+public:
+	explicit TightEncoder() = default;
+
+	std::string uid() const override
+	{
+		return "95d80fe7-696a-4d86-9875-5a6008cecbff";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "TightEncoder";
+	}
+
+	std::string description() const override
+	{
+		return "Tight encoder with parallel tile compression";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	bool initialize( Core::Server* server ) override;
+
+	int32_t encoding() const override
+	{
+		return EncodingTight;
+	}
+
+	Types::Size tileSize() const override
+	{
+		return { TileSize, TileSize };
+	}
+
+	bool encode( const Types::Image& image, const Types::PixelFormat& sourceFormat,
+				 const Types::Rectangle& rect, const TargetFormat& targetFormat,
+				 ClientState* clientState, std::vector<uint8_t>* output ) override;
+
+private:
+	static constexpr int32_t EncodingTight = 7;
+	static constexpr auto TileSize = 128;
+	static constexpr auto MaximumRectWidth = 2048;
+	static constexpr auto DefaultCompressionLevel = 6;
+	// smaller pixel data is sent without compression as required by the protocol
+	static constexpr size_t MinimumSizeToCompress = 12;
+	static constexpr uint8_t ControlResetStream0 = 0x01;
+	static constexpr uint8_t ControlFill = 0x80;
+
+	bool compress( const std::vector<uint8_t>& data, std::vector<uint8_t>* output ) const;
+	static void appendCompactLength( size_t length, std::vector<uint8_t>* output );
+
+	int m_compressionLevel{DefaultCompressionLevel};
+
+};
+
+}
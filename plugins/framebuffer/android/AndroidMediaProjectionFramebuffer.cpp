@@ -35,119 +35,23 @@
 namespace AnyVnc
 {
 
-template<AndroidMediaProjectionFramebuffer::AndroidPixelFormat>
-QRgb pixelToRgb( const uchar* scanLine, int x );
-
-template<>
-QRgb pixelToRgb<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGBA_8888>( const uchar* scanLine, int x )
-{
-	return qRgb( scanLine[x*4+0], scanLine[x*4+1], scanLine[x*4+2] );
-}
-
-
-template<>
-QRgb pixelToRgb<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_888>( const uchar* scanLine, int x )
-{
-	return qRgb( scanLine[x*3+0], scanLine[x*3+1], scanLine[x*3+2] );
-}
-
-
-template<>
-QRgb pixelToRgb<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_565>( const uchar* scanLine, int x )
-{
-	const auto pixel = reinterpret_cast<const uint16_t *>( scanLine )[x];
-	return qRgb( pixel >> 11, ( pixel >> 5 ) & 63, pixel & 31 );
-}
-
-
-template<AndroidMediaProjectionFramebuffer::AndroidPixelFormat PIXEL_FORMAT>
-void convertAndScan( const uchar* sourceImageData, int sourceRowStride, int width, int height, QRgb* destination,
-					AndroidMediaProjectionFramebuffer::RectVector* rects )
+static bool toSourceFormat( AndroidMediaProjectionFramebuffer::AndroidPixelFormat format,
+							Core::PixelConverter::SourceFormat* sourceFormat )
 {
-	Types::Rectangle currentRect;
-
-	for( int y = 0; y < height; ++y )
-	{
-		int minX = -1, maxX = -1;
-		const auto sourceScanLine = sourceImageData + y * sourceRowStride;
-		auto destinationScanLine = destination + y * width;
-
-		for( int x = 0; x < width; ++x )
-		{
-			const auto sourcePixel = pixelToRgb<PIXEL_FORMAT>( sourceScanLine, x );
-
-			if( sourcePixel != destinationScanLine[x] )
-			{
-				destinationScanLine[x] = sourcePixel;
-				if( minX < 0 )
-				{
-					minX = x;
-				}
-				maxX = x;
-			}
-		}
-
-		if( minX >= 0 )
-		{
-			if( currentRect.isValid() )
-			{
-				if( minX < currentRect.left() )
-				{
-					currentRect.setLeft( minX );
-				}
-				if( maxX > currentRect.right() )
-				{
-					currentRect.setRight( maxX );
-				}
-				currentRect.setBottom( y );
-			}
-			else
-			{
-				currentRect = { minX, y, maxX, y };
-			}
-		}
-		else if( currentRect.isValid() )
-		{
-			rects->append( currentRect );
-			currentRect = {};
-		}
-	}
+	using AndroidPixelFormat = AndroidMediaProjectionFramebuffer::AndroidPixelFormat;
+	using SourceFormat = Core::PixelConverter::SourceFormat;
 
-	if( currentRect.isValid() )
-	{
-		rects->append( currentRect );
-	}
-}
-
-
-
-static void updateBuffer( const uchar* sourceImageData,
-				  AndroidMediaProjectionFramebuffer::AndroidPixelFormat sourceFormat,
-				  int sourceRowStride, QRgb* data, Types::Size size,
-				  AndroidMediaProjectionFramebuffer::RectVector* rects )
-{
-	switch( sourceFormat )
+	switch( format )
 	{
-	case AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGBA_8888:
-	case AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGBX_8888:
-		convertAndScan<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGBA_8888>(
-			sourceImageData, sourceRowStride, size.width(), size.height(), data, rects );
-		break;
-
-	case AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_888:
-		convertAndScan<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_888>(
-			sourceImageData, sourceRowStride, size.width(), size.height(), data, rects );
-		break;
-
-	case AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_565:
-		convertAndScan<AndroidMediaProjectionFramebuffer::AndroidPixelFormat::RGB_565>(
-			sourceImageData, sourceRowStride, size.width(), size.height(), data, rects );
-		break;
-
+	case AndroidPixelFormat::RGBA_8888: *sourceFormat = SourceFormat::RGBA8888; return true;
+	case AndroidPixelFormat::RGBX_8888: *sourceFormat = SourceFormat::RGBX8888; return true;
+	case AndroidPixelFormat::RGB_888: *sourceFormat = SourceFormat::RGB888; return true;
+	case AndroidPixelFormat::RGB_565: *sourceFormat = SourceFormat::RGB565; return true;
 	default:
-		avqCritical() << "Invalid image format:" << int(sourceFormat);
 		break;
 	}
+
+	return false;
 }
 
 
@@ -171,7 +75,9 @@ bool AndroidMediaProjectionFramebuffer::initialize( Core::Server* )
 
 	QtAndroid::startActivity( intent, RequestCodeCapturePermission, this );
 
-	while( update( []( Types::Rectangle ) {} ) & UpdateFlag::Initializing )
+	Types::Region damage;
+	Types::Moves moves;
+	while( update( &damage, &moves ) & UpdateFlag::Initializing )
 	{
 		QThread::msleep( 100 );
 	}
@@ -195,13 +101,12 @@ Types::Size AndroidMediaProjectionFramebuffer::size() const
 
 
 
-AndroidMediaProjectionFramebuffer::UpdateFlags AndroidMediaProjectionFramebuffer::update(
-		const Interfaces::Framebuffer::RectangleVisitor& visitor )
+AndroidMediaProjectionFramebuffer::UpdateFlags AndroidMediaProjectionFramebuffer::update( Types::Region* damage, Types::Moves* )
 {
-	RectVector rects;
+	Types::Region changedRegion;
 	UpdateFlags updateFlags{};
 
-	const auto state = readMediaProjectionBuffer( &rects );
+	const auto state = readMediaProjectionBuffer( &changedRegion );
 
 	switch( state )
 	{
@@ -211,10 +116,7 @@ AndroidMediaProjectionFramebuffer::UpdateFlags AndroidMediaProjectionFramebuffer
 	case BufferState::Rotated: updateFlags |= UpdateFlag::SizeChanged; break;
 	case BufferState::Ready: return UpdateFlags{ UpdateFlag::None };
 	case BufferState::Updated:
-		for( const auto& rect : qAsConst(rects) )
-		{
-			visitor( rect );
-		}
+		damage->add( changedRegion );
 		break;
 	}
 
@@ -260,7 +162,7 @@ void AndroidMediaProjectionFramebuffer::handleActivityResult( int receiverReques
 
 
 
-AndroidMediaProjectionFramebuffer::BufferState AndroidMediaProjectionFramebuffer::readMediaProjectionBuffer( RectVector* rects )
+AndroidMediaProjectionFramebuffer::BufferState AndroidMediaProjectionFramebuffer::readMediaProjectionBuffer( Types::Region* damage )
 {
 	QElapsedTimer benchTimer;
 	benchTimer.start();
@@ -270,7 +172,7 @@ AndroidMediaProjectionFramebuffer::BufferState AndroidMediaProjectionFramebuffer
 
 	QMutexLocker locker( &m_screenCapturerMutex );
 
-	if( rects && m_screenCapturer.isValid())
+	if( damage && m_screenCapturer.isValid())
 	{
 		avqDebug() << "Capturing image";
 
@@ -344,12 +246,20 @@ AndroidMediaProjectionFramebuffer::BufferState AndroidMediaProjectionFramebuffer
 			const auto byteBufferObject = byteBuffer.object<jobject>();
 			const auto sourceImageData = reinterpret_cast<const uchar *>( qjniEnv->GetDirectBufferAddress(byteBufferObject) );
 
-			updateBuffer( sourceImageData, imageFormat, rowStride, m_data, m_size, rects );
+			Core::PixelConverter::SourceFormat sourceFormat;
+			if( toSourceFormat( imageFormat, &sourceFormat ) == false )
+			{
+				avqCritical() << "Invalid image format:" << int(imageFormat);
+				continue;
+			}
+
+			m_pixelConverter.convert( sourceFormat, sourceImageData, rowStride,
+									  m_data, m_size.width() * int(sizeof(QRgb)), m_size, damage );
 		}
 
 		avqDebug() << "Finished in" << benchTimer.elapsed();
 		return rotated ? BufferState::Rotated :
-					   rects->isEmpty() ? BufferState::Ready :
+					   damage->isEmpty() ? BufferState::Ready :
 										BufferState::Updated ;
 	}
 
@@ -31,6 +31,7 @@
 #include <QRect>
 #include <QVector>
 
+#include "libanyvnc/core/PixelConverter.h"
 #include "libanyvnc/interfaces/Framebuffer.h"
 
 namespace AnyVnc
@@ -49,8 +50,6 @@ public:
 		RGB_565 = 4,
 	};
 
-	using RectVector = QVector<Types::Rectangle>;
-
 	explicit AndroidMediaProjectionFramebuffer() = default;
 
 	std::string uid() const override
@@ -93,7 +92,7 @@ public:
 	void* data() const override;
 	Types::Size size() const override;
 
-	UpdateFlags update( const RectangleVisitor& visitor ) override;
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
 
 	Types::Screens availableScreens() const override;
 
@@ -114,7 +113,7 @@ private:
 		SizeChanged,
 	};
 
-	BufferState readMediaProjectionBuffer( RectVector* rects );
+	BufferState readMediaProjectionBuffer( Types::Region* damage );
 
 	QMutex m_screenCapturerMutex;
 	AJO m_screenCapturer;
@@ -122,6 +121,8 @@ private:
 	QRgb* m_data{nullptr};
 	Types::Size m_size;
 
+	Core::PixelConverter m_pixelConverter;
+
 };
 
 }
@@ -43,13 +43,18 @@ void* DummyFramebuffer::data() const
 
 Types::Size DummyFramebuffer::size() const
 {
-	return { DummyResolutionX, DummyResolutionY };
+	return { DummyResolutionX * DummyScreenCount, DummyResolutionY };
 }
 
 
 
-DummyFramebuffer::UpdateFlags DummyFramebuffer::update( const Interfaces::Framebuffer::RectangleVisitor& )
+DummyFramebuffer::UpdateFlags DummyFramebuffer::update( Types::Region* damage, Types::Moves* )
 {
+	const auto framebufferSize = size();
+
+	m_damageDetector.detect( m_framebufferData, framebufferSize, framebufferSize.width() * int(sizeof(uint32_t)),
+							 int(sizeof(uint32_t)), damage );
+
 	return DummyFramebuffer::UpdateFlags{ UpdateFlag::None };
 }
 
@@ -57,7 +62,15 @@ DummyFramebuffer::UpdateFlags DummyFramebuffer::update( const Interfaces::Frameb
 
 Types::Screens DummyFramebuffer::availableScreens() const
 {
-	return { { size(), 32 } };
+	// screens arranged side by side
+	Types::Screens screens;
+	for( int i = 0; i < DummyScreenCount; ++i )
+	{
+		screens.emplace_back( Types::Size{ DummyResolutionX, DummyResolutionY }, 32,
+							  Types::Point{ i * DummyResolutionX, 0 } );
+	}
+
+	return screens;
 }
 
 }
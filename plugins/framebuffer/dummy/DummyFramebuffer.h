@@ -26,6 +26,7 @@
 
 #include <array>
 
+#include "libanyvnc/core/TileDamageDetector.h"
 #include "libanyvnc/interfaces/Framebuffer.h"
 
 namespace AnyVnc
@@ -73,16 +74,20 @@ public:
 	void* data() const override;
 	Types::Size size() const override;
 
-	UpdateFlags update( const RectangleVisitor& visitor ) override;
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
 
 	Types::Screens availableScreens() const override;
 
 private:
 	static constexpr auto DummyResolutionX = 100;
 	static constexpr auto DummyResolutionY = 100;
+	static constexpr auto DummyScreenCount = 2;
 
-	std::array<uint32_t, DummyResolutionX*DummyResolutionY> m_dummyFramebuffer{};
+	std::array<uint32_t, DummyResolutionX*DummyScreenCount*DummyResolutionY> m_dummyFramebuffer{};
 	void* m_framebufferData{m_dummyFramebuffer.data()};
+
+	// the dummy framebuffer has no change notifications, so it is polled and compared
+	Core::TileDamageDetector m_damageDetector;
 };
 
 }
@@ -0,0 +1,228 @@
+/*
+ * QtWindowFramebuffer.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QQuickWindow>
+#include <QSGRendererInterface>
+
+#include "libanyvnc/qt/core/AnyVncQt.h"
+#include "QtWindowFramebuffer.h"
+
+namespace AnyVnc
+{
+
+QtWindowFramebuffer::~QtWindowFramebuffer()
+{
+	for( const auto& connection : qAsConst(m_connections) )
+	{
+		QObject::disconnect( connection );
+	}
+}
+
+
+
+bool QtWindowFramebuffer::initialize( Core::Server* )
+{
+	if( qobject_cast<QGuiApplication *>( QCoreApplication::instance() ) == nullptr )
+	{
+		avqCritical() << "no QGuiApplication instance";
+		return false;
+	}
+
+	m_window = findWindow();
+	if( m_window.isNull() )
+	{
+		avqCritical() << "no Qt Quick window to capture";
+		return false;
+	}
+
+	// served until the first frame has been rendered
+	m_frame = QImage( m_window->size() * m_window->devicePixelRatio(), QImage::Format_RGB32 );
+	m_frame.fill( Qt::black );
+
+	const auto window = m_window.data();
+	const auto queue = m_frameQueue;
+
+	m_connections.append( QObject::connect( window, &QQuickWindow::afterRendering, window,
+											[window, queue]() { grabFrame( window, queue.get() ); },
+											Qt::DirectConnection ) );
+
+	QMetaObject::invokeMethod( window, "update", Qt::QueuedConnection );
+
+	return true;
+}
+
+
+
+void* QtWindowFramebuffer::data() const
+{
+	return const_cast<uchar *>( m_frame.constBits() );
+}
+
+
+
+Types::Size QtWindowFramebuffer::size() const
+{
+	return { m_frame.width(), m_frame.height() };
+}
+
+
+
+int QtWindowFramebuffer::bytesPerLine() const
+{
+	return m_frame.bytesPerLine();
+}
+
+
+
+QtWindowFramebuffer::UpdateFlags QtWindowFramebuffer::update( Types::Region* damage, Types::Moves* )
+{
+	if( m_window.isNull() )
+	{
+		return UpdateFlags{ UpdateFlag::RequiresRestart };
+	}
+
+	// reset before taking the frame so that later frames signal again
+	m_frameQueue->frameAvailable.reset();
+
+	QImage frame;
+	{
+		QMutexLocker locker( &m_frameQueue->mutex );
+		frame.swap( m_frameQueue->pendingFrame );
+	}
+
+	if( frame.isNull() )
+	{
+		return UpdateFlags{ UpdateFlag::None };
+	}
+
+	UpdateFlags updateFlags{};
+
+	if( frame.size() != m_frame.size() )
+	{
+		updateFlags |= UpdateFlag::SizeChanged;
+		m_damageDetector.reset();
+	}
+
+	m_frame = std::move(frame);
+
+	m_damageDetector.detect( m_frame.constBits(), size(), m_frame.bytesPerLine(), int(sizeof(QRgb)), damage );
+
+	return updateFlags;
+}
+
+
+
+Types::Screens QtWindowFramebuffer::availableScreens() const
+{
+	return { Types::Screen{ size(), pixelFormat().depth() } };
+}
+
+
+
+Types::EventHandle QtWindowFramebuffer::damageEvent() const
+{
+	return m_frameQueue->frameAvailable.handle();
+}
+
+
+
+QQuickWindow* QtWindowFramebuffer::findWindow()
+{
+	const auto objectName = qEnvironmentVariable( "ANYVNC_QT_WINDOW" );
+
+	for( auto window : QGuiApplication::topLevelWindows() )
+	{
+		auto quickWindow = qobject_cast<QQuickWindow *>( window );
+		if( quickWindow &&
+			( objectName.isEmpty() ? quickWindow->isVisible() : quickWindow->objectName() == objectName ) )
+		{
+			return quickWindow;
+		}
+	}
+
+	return nullptr;
+}
+
+
+
+void QtWindowFramebuffer::grabFrame( QQuickWindow* window, FrameQueue* queue )
+{
+	QImage frame;
+
+	if( window->rendererInterface()->graphicsApi() == QSGRendererInterface::OpenGL )
+	{
+		// emitted on the render thread with the window's context still current
+		const auto context = QOpenGLContext::currentContext();
+		if( context == nullptr )
+		{
+			return;
+		}
+
+		const auto frameSize = window->size() * window->effectiveDevicePixelRatio();
+		frame = QImage( frameSize, QImage::Format_RGBA8888_Premultiplied );
+		context->functions()->glReadPixels( 0, 0, frameSize.width(), frameSize.height(),
+											GL_RGBA, GL_UNSIGNED_BYTE, frame.bits() );
+
+		// OpenGL starts with the bottom line
+		frame = frame.mirrored().convertToFormat( QImage::Format_RGB32 );
+	}
+	else
+	{
+		// other backends (e.g. software with QT_QPA_PLATFORM=offscreen) render on
+		// the GUI thread - grabbing renders the scene once more and emits
+		// afterRendering() again which must not recurse
+		{
+			QMutexLocker locker( &queue->mutex );
+			if( queue->grabbing )
+			{
+				return;
+			}
+			queue->grabbing = true;
+		}
+
+		frame = window->grabWindow().convertToFormat( QImage::Format_RGB32 );
+
+		QMutexLocker locker( &queue->mutex );
+		queue->grabbing = false;
+	}
+
+	if( frame.isNull() )
+	{
+		return;
+	}
+
+	{
+		QMutexLocker locker( &queue->mutex );
+		queue->pendingFrame = std::move(frame);
+	}
+
+	queue->frameAvailable.signal();
+}
+
+}
+
+ANYVNC_EXPORT_PLUGIN(AnyVnc::QtWindowFramebuffer)
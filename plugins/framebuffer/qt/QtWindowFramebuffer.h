@@ -0,0 +1,127 @@
+/*
+ * QtWindowFramebuffer.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <QImage>
+#include <QMutex>
+#include <QPointer>
+#include <QVector>
+
+#include "libanyvnc/core/Event.h"
+#include "libanyvnc/core/TileDamageDetector.h"
+#include "libanyvnc/interfaces/Framebuffer.h"
+
+class QQuickWindow;
+
+namespace AnyVnc
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+// serves a QQuickWindow of the application the server runs in - the window
+// is looked up by the object name given in ANYVNC_QT_WINDOW and defaults to
+// the first visible top level window
+class QtWindowFramebuffer : public Interfaces::Framebuffer
+{
+public:
+	explicit QtWindowFramebuffer() = default;
+	~QtWindowFramebuffer() override;
+
+	std::string uid() const override
+	{
+		return "5a9c1e47-d3b2-4f86-a0e5-7c4b29f8d613";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "QtWindowFramebuffer";
+	}
+
+	std::string description() const override
+	{
+		return "Framebuffer grabbed from a Qt Quick window of the application";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	Flags flags() const override
+	{
+		return Flags{ Flag::RequiresExplicitSelection };
+	}
+
+	bool initialize( Core::Server* server ) override;
+
+	void* data() const override;
+	Types::Size size() const override;
+	int bytesPerLine() const override;
+
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
+
+	Types::Screens availableScreens() const override;
+
+	Types::EventHandle damageEvent() const override;
+
+private:
+	// shared with the render thread which may still be grabbing a frame
+	// while the framebuffer is destroyed
+	struct FrameQueue
+	{
+		QMutex mutex;
+		QImage pendingFrame;
+		Core::Event frameAvailable;
+		bool grabbing{false};
+	};
+
+	static QQuickWindow* findWindow();
+	static void grabFrame( QQuickWindow* window, FrameQueue* queue );
+
+	QPointer<QQuickWindow> m_window;
+	QVector<QMetaObject::Connection> m_connections;
+	std::shared_ptr<FrameQueue> m_frameQueue{std::make_shared<FrameQueue>()};
+
+	// only modified in update() so that data() stays valid in between
+	QImage m_frame;
+
+	// Qt Quick only renders if the scene has changed but doesn't tell which parts
+	Core::TileDamageDetector m_damageDetector;
+
+};
+
+}
@@ -0,0 +1,293 @@
+/*
+ * SharedMemoryFramebuffer.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "SharedMemoryFramebuffer.h"
+
+namespace AnyVnc
+{
+
+SharedMemoryFramebuffer::~SharedMemoryFramebuffer()
+{
+	m_running = false;
+	if( m_watcherThread.joinable() )
+	{
+		m_watcherThread.join();
+	}
+
+	if( m_header )
+	{
+		munmap( m_header, m_mappingSize );
+	}
+}
+
+
+
+bool SharedMemoryFramebuffer::initialize( Core::Server* )
+{
+	const auto configuredName = std::getenv( "ANYVNC_SHARED_FRAMEBUFFER" );
+	const std::string name = configuredName ? configuredName : Producer::SharedFramebufferDefaultName;
+
+	const auto fd = shm_open( name.c_str(), O_RDONLY, 0 );
+	if( fd < 0 )
+	{
+		std::cerr << "SharedMemoryFramebuffer: could not open " << name << std::endl;
+		return false;
+	}
+
+	struct stat status{};
+	if( fstat( fd, &status ) != 0 || size_t(status.st_size) < sizeof(Header) )
+	{
+		close( fd );
+		std::cerr << "SharedMemoryFramebuffer: " << name << " is not a shared framebuffer" << std::endl;
+		return false;
+	}
+
+	const auto mappingSize = size_t(status.st_size);
+	const auto mapping = mmap( nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if( mapping == MAP_FAILED )
+	{
+		return false;
+	}
+
+	m_header = static_cast<Header *>( mapping );
+	m_mappingSize = mappingSize;
+
+	if( validateHeader( mappingSize ) == false )
+	{
+		std::cerr << "SharedMemoryFramebuffer: " << name << " has an invalid or unsupported layout" << std::endl;
+		return false;
+	}
+
+	m_counter = m_header->counter.load( std::memory_order_acquire );
+	m_fullDamagePending = true;
+
+#ifdef __linux__
+	m_running = true;
+	m_watcherThread = std::thread( [this]() { watchCounter(); } );
+#endif
+
+	return true;
+}
+
+
+
+void* SharedMemoryFramebuffer::data() const
+{
+	return reinterpret_cast<uint8_t *>( m_header ) + m_header->dataOffset;
+}
+
+
+
+Types::Size SharedMemoryFramebuffer::size() const
+{
+	return { int(m_header->width), int(m_header->height) };
+}
+
+
+
+Types::PixelFormat SharedMemoryFramebuffer::pixelFormat() const
+{
+	return { int(m_header->bitsPerPixel), int(m_header->depth),
+			 int(m_header->redMax), int(m_header->greenMax), int(m_header->blueMax),
+			 int(m_header->redShift), int(m_header->greenShift), int(m_header->blueShift) };
+}
+
+
+
+int SharedMemoryFramebuffer::bytesPerLine() const
+{
+	return int(m_header->bytesPerLine);
+}
+
+
+
+SharedMemoryFramebuffer::UpdateFlags SharedMemoryFramebuffer::update( Types::Region* damage, Types::Moves* moves )
+{
+	// reset before reading the counter so that later changes signal again
+	m_damageEvent.reset();
+
+	if( m_header->closed.load( std::memory_order_acquire ) )
+	{
+		// the producer has gone away, pick up a new segment or another framebuffer
+		return UpdateFlags{ UpdateFlag::RequiresRestart };
+	}
+
+	const auto counter = m_header->counter.load( std::memory_order_acquire );
+	const Types::Rectangle bounds{ 0, 0, int(m_header->width) - 1, int(m_header->height) - 1 };
+
+	if( m_fullDamagePending || readChanges( counter, damage, moves ) == false )
+	{
+		damage->add( bounds );
+		m_fullDamagePending = false;
+	}
+
+	m_counter = counter;
+
+	return UpdateFlags{ UpdateFlag::None };
+}
+
+
+
+Types::Screens SharedMemoryFramebuffer::availableScreens() const
+{
+	return { Types::Screen{ size(), int(m_header->depth) } };
+}
+
+
+
+Types::EventHandle SharedMemoryFramebuffer::damageEvent() const
+{
+#ifdef __linux__
+	return m_damageEvent.handle();
+#else
+	return Types::InvalidEventHandle;
+#endif
+}
+
+
+
+bool SharedMemoryFramebuffer::validateHeader( size_t mappingSize ) const
+{
+	if( m_header->magic != Header::Magic )
+	{
+		return false;
+	}
+
+	std::atomic_thread_fence( std::memory_order_acquire );
+
+	const auto bytesPerPixel = m_header->bitsPerPixel / 8;
+
+	return m_header->version == Header::CurrentVersion &&
+			m_header->width > 0 && m_header->height > 0 &&
+			( m_header->bitsPerPixel == 8 || m_header->bitsPerPixel == 16 || m_header->bitsPerPixel == 32 ) &&
+			m_header->bytesPerLine >= size_t(m_header->width) * bytesPerPixel &&
+			m_header->dataOffset >= sizeof(Header) &&
+			m_header->dataOffset + size_t(m_header->bytesPerLine) * m_header->height <= mappingSize;
+}
+
+
+
+bool SharedMemoryFramebuffer::readChanges( uint32_t counter, Types::Region* damage, Types::Moves* moves ) const
+{
+	// unsigned arithmetic keeps working when the counter wraps around
+	const auto count = counter - m_counter;
+	if( count >= Header::MaxChanges )
+	{
+		return false;
+	}
+
+	const Types::Rectangle bounds{ 0, 0, int(m_header->width) - 1, int(m_header->height) - 1 };
+
+	Types::Region changedRegion;
+	Types::Moves changedMoves;
+
+	for( uint32_t i = 0; i < count; ++i )
+	{
+		Change change;
+		memcpy( &change, &m_header->changes[( m_counter + i ) % Header::MaxChanges], sizeof(change) );
+
+		if( change.width <= 0 || change.height <= 0 )
+		{
+			continue;
+		}
+
+		const Types::Rectangle rect( change.x, change.y, change.x + change.width - 1, change.y + change.height - 1 );
+		const auto clippedRect = rect.intersected( bounds );
+
+		if( change.type == Change::Move && clippedRect == rect &&
+			rect.translated( -change.dx, -change.dy ).intersected( bounds ) == rect.translated( -change.dx, -change.dy ) )
+		{
+			Types::appendMove( Types::Move( rect, change.dx, change.dy ), &changedRegion, &changedMoves );
+		}
+		else if( clippedRect.isEmpty() == false )
+		{
+			changedRegion.add( clippedRect );
+		}
+	}
+
+	// the producer doesn't wait for us, so records may have been overwritten
+	// while reading them
+	std::atomic_thread_fence( std::memory_order_acquire );
+	if( m_header->counter.load( std::memory_order_relaxed ) - m_counter >= Header::MaxChanges )
+	{
+		return false;
+	}
+
+	// damage reported earlier moves along with the contents
+	for( const auto& move : changedMoves )
+	{
+		Types::appendMove( move, damage, moves );
+	}
+	damage->add( changedRegion );
+
+	return true;
+}
+
+
+
+void SharedMemoryFramebuffer::watchCounter()
+{
+#ifdef __linux__
+	// wake up regularly to notice shutdown requests
+	static constexpr timespec WaitTimeout{ 0, 100 * 1000 * 1000 };
+
+	// report the initial contents
+	m_damageEvent.signal();
+
+	auto observedCounter = m_header->counter.load( std::memory_order_acquire );
+
+	while( m_running )
+	{
+		auto timeout = WaitTimeout;
+		syscall( SYS_futex, reinterpret_cast<uint32_t *>( &m_header->counter ), FUTEX_WAIT, observedCounter, &timeout, nullptr, 0 );
+
+		const auto counter = m_header->counter.load( std::memory_order_acquire );
+		if( counter != observedCounter || m_header->closed.load( std::memory_order_acquire ) )
+		{
+			observedCounter = counter;
+			m_damageEvent.signal();
+		}
+	}
+#endif
+}
+
+}
+
+ANYVNC_EXPORT_PLUGIN(AnyVnc::SharedMemoryFramebuffer)
@@ -0,0 +1,116 @@
+/*
+ * SharedMemoryFramebuffer.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "libanyvnc/core/Event.h"
+#include "libanyvnc/interfaces/Framebuffer.h"
+#include "libanyvnc/producer/SharedFramebufferLayout.h"
+
+namespace AnyVnc
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+// serves a framebuffer which another process renders into through
+// Producer::SharedFramebufferProducer - the name of the shared memory object
+// is read from ANYVNC_SHARED_FRAMEBUFFER and defaults to /anyvnc-framebuffer
+class SharedMemoryFramebuffer : public Interfaces::Framebuffer
+{
+public:
+	explicit SharedMemoryFramebuffer() = default;
+	~SharedMemoryFramebuffer() override;
+
+	std::string uid() const override
+	{
+		return "e27b94c1-5f0d-4a8e-8c63-91d4a7f0b2e8";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "SharedMemoryFramebuffer";
+	}
+
+	std::string description() const override
+	{
+		return "Framebuffer provided by another process through shared memory";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	Flags flags() const override
+	{
+		return Flags{ Flag::RequiresExplicitSelection };
+	}
+
+	bool initialize( Core::Server* server ) override;
+
+	void* data() const override;
+	Types::Size size() const override;
+	Types::PixelFormat pixelFormat() const override;
+	int bytesPerLine() const override;
+
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
+
+	Types::Screens availableScreens() const override;
+
+	Types::EventHandle damageEvent() const override;
+
+private:
+	using Header = Producer::SharedFramebufferHeader;
+	using Change = Producer::SharedFramebufferChange;
+
+	bool validateHeader( size_t mappingSize ) const;
+	bool readChanges( uint32_t counter, Types::Region* damage, Types::Moves* moves ) const;
+	void watchCounter();
+
+	Header* m_header{nullptr};
+	size_t m_mappingSize{0};
+	uint32_t m_counter{0};
+	bool m_fullDamagePending{true};
+
+	// turns futex wakeups of the producer into a selectable event
+	Core::Event m_damageEvent;
+	std::thread m_watcherThread;
+	std::atomic<bool> m_running{false};
+
+};
+
+}
@@ -0,0 +1,654 @@
+/*
+ * SyntheticFramebuffer.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "SyntheticFramebuffer.h"
+
+namespace AnyVnc
+{
+
+static constexpr uint32_t BackgroundColor = 0x2b3a4a;
+static constexpr uint32_t BackgroundPatternColor = 0x324354;
+static constexpr uint32_t TextBackgroundColor = 0xf2f2f2;
+static constexpr uint32_t TextColor = 0x202020;
+static constexpr uint32_t WindowColor = 0xd8d8d8;
+static constexpr uint32_t WindowTitleColor = 0x3465a4;
+static constexpr uint32_t CaretColor = 0xffffff;
+
+
+
+// cheap integer hash so that all generated content only depends on its inputs
+static uint32_t mix( uint32_t a, uint32_t b )
+{
+	auto h = a * 0x9e3779b1u ^ ( b + 0x7f4a7c15u );
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+
+
+bool SyntheticFramebuffer::initialize( Core::Server* )
+{
+	if( readConfiguration() == false )
+	{
+		return false;
+	}
+
+	m_pixels.resize( size_t(m_size.width()) * size_t(m_size.height()) );
+	m_framebufferData = m_pixels.data();
+
+	renderInitialFrame();
+
+	if( m_frameRate > 0 )
+	{
+		m_nextFrameTime = std::chrono::steady_clock::now() + std::chrono::seconds(1) / m_frameRate;
+	}
+
+	return true;
+}
+
+
+
+void* SyntheticFramebuffer::data() const
+{
+	return m_framebufferData;
+}
+
+
+
+Types::Size SyntheticFramebuffer::size() const
+{
+	return m_size;
+}
+
+
+
+SyntheticFramebuffer::UpdateFlags SyntheticFramebuffer::update( Types::Region* damage, Types::Moves* moves )
+{
+	if( m_frameRate <= 0 )
+	{
+		renderFrame( damage, moves );
+		return UpdateFlags{ UpdateFlag::None };
+	}
+
+	// render every frame in order even if updates are delayed so that the
+	// sequence of contents is the same on every run
+	const auto now = std::chrono::steady_clock::now();
+	if( now - m_nextFrameTime > MaximumFrameLag )
+	{
+		m_nextFrameTime = now;
+	}
+
+	const auto frameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::seconds(1) ) / m_frameRate;
+
+	while( m_nextFrameTime <= now )
+	{
+		renderFrame( damage, moves );
+		m_nextFrameTime += frameInterval;
+	}
+
+	return UpdateFlags{ UpdateFlag::None };
+}
+
+
+
+Types::Screens SyntheticFramebuffer::availableScreens() const
+{
+	return { Types::Screen{ m_size, pixelFormat().depth() } };
+}
+
+
+
+bool SyntheticFramebuffer::readConfiguration()
+{
+	const auto workload = std::getenv( "ANYVNC_SYNTHETIC_WORKLOAD" );
+	if( workload == nullptr || strcmp( workload, "idle" ) == 0 )
+	{
+		m_workload = Workload::Idle;
+	}
+	else if( strcmp( workload, "scroll" ) == 0 )
+	{
+		m_workload = Workload::Scroll;
+	}
+	else if( strcmp( workload, "drag" ) == 0 )
+	{
+		m_workload = Workload::Drag;
+	}
+	else if( strcmp( workload, "noise" ) == 0 )
+	{
+		m_workload = Workload::Noise;
+	}
+	else if( strcmp( workload, "replay" ) == 0 )
+	{
+		m_workload = Workload::Replay;
+	}
+	else
+	{
+		std::cerr << "SyntheticFramebuffer: unknown workload " << workload << std::endl;
+		return false;
+	}
+
+	const auto resolution = std::getenv( "ANYVNC_SYNTHETIC_RESOLUTION" );
+	if( resolution )
+	{
+		int width = 0;
+		int height = 0;
+		if( sscanf( resolution, "%dx%d", &width, &height ) != 2 ||
+			width < MinimumSize || height < MinimumSize ||
+			width > MaximumSize || height > MaximumSize )
+		{
+			std::cerr << "SyntheticFramebuffer: invalid resolution " << resolution << std::endl;
+			return false;
+		}
+		m_size = { width, height };
+	}
+
+	const auto frameRate = std::getenv( "ANYVNC_SYNTHETIC_RATE" );
+	if( frameRate )
+	{
+		m_frameRate = std::max( atoi( frameRate ), 0 );
+	}
+
+	const auto seed = std::getenv( "ANYVNC_SYNTHETIC_SEED" );
+	if( seed )
+	{
+		m_seed = uint32_t(strtoul( seed, nullptr, 10 ));
+	}
+
+	if( m_workload == Workload::Replay )
+	{
+		const auto trace = std::getenv( "ANYVNC_SYNTHETIC_TRACE" );
+		if( trace == nullptr )
+		{
+			std::cerr << "SyntheticFramebuffer: no trace given for replay workload" << std::endl;
+			return false;
+		}
+
+		return readTrace( trace );
+	}
+
+	return true;
+}
+
+
+
+bool SyntheticFramebuffer::readTrace( const std::string& fileName )
+{
+	std::ifstream file( fileName );
+	if( file.is_open() == false )
+	{
+		std::cerr << "SyntheticFramebuffer: could not open trace " << fileName << std::endl;
+		return false;
+	}
+
+	const auto framebufferBounds = bounds();
+
+	std::string line;
+	int lineNumber = 0;
+	while( std::getline( file, line ) )
+	{
+		++lineNumber;
+
+		const auto comment = line.find( '#' );
+		if( comment != std::string::npos )
+		{
+			line.erase( comment );
+		}
+
+		std::istringstream stream( line );
+		std::string command;
+		if( !( stream >> command ) )
+		{
+			continue;
+		}
+
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+		int dx = 0;
+		int dy = 0;
+
+		if( command == "frame" )
+		{
+			m_trace.push_back( { TraceCommand::Type::Frame, {}, 0, 0 } );
+		}
+		else if( command == "fill" && stream >> x >> y >> width >> height )
+		{
+			const auto rect = Types::Rectangle( x, y, x + width - 1, y + height - 1 ).intersected( framebufferBounds );
+			if( rect.isEmpty() == false )
+			{
+				m_trace.push_back( { TraceCommand::Type::Fill, rect, 0, 0 } );
+			}
+		}
+		else if( command == "copy" && stream >> x >> y >> width >> height >> dx >> dy )
+		{
+			// both source and destination have to lie within the framebuffer
+			const auto rect = Types::Rectangle( x, y, x + width - 1, y + height - 1 )
+								  .intersected( framebufferBounds )
+								  .intersected( framebufferBounds.translated( dx, dy ) );
+			if( rect.isEmpty() == false )
+			{
+				m_trace.push_back( { TraceCommand::Type::Copy, rect, dx, dy } );
+			}
+		}
+		else
+		{
+			std::cerr << "SyntheticFramebuffer: invalid command in line " << lineNumber << " of " << fileName << std::endl;
+			return false;
+		}
+	}
+
+	if( m_trace.empty() )
+	{
+		std::cerr << "SyntheticFramebuffer: trace " << fileName << " is empty" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+void SyntheticFramebuffer::renderInitialFrame()
+{
+	const auto framebufferBounds = bounds();
+
+	switch( m_workload )
+	{
+	case Workload::Idle:
+		fillBackground( framebufferBounds );
+		fillCaret( true );
+		break;
+	case Workload::Scroll:
+	{
+		// bottom aligned lines so that newly scrolled in lines continue them
+		const auto visibleLines = ( m_size.height() + LineHeight - 1 ) / LineHeight;
+		for( int i = 0; i < visibleLines; ++i )
+		{
+			drawTextLine( m_size.height() - ( visibleLines - i ) * LineHeight, uint32_t(i) );
+		}
+		break;
+	}
+	case Workload::Drag:
+		fillBackground( framebufferBounds );
+		m_windowPosition = { m_size.width() / 8, m_size.height() / 8 };
+		fillWindow( windowRect() );
+		break;
+	case Workload::Noise:
+		fillNoise( framebufferBounds, mix( m_seed, 0 ) );
+		break;
+	case Workload::Replay:
+		fillBackground( framebufferBounds );
+		break;
+	}
+}
+
+
+
+void SyntheticFramebuffer::renderFrame( Types::Region* damage, Types::Moves* moves )
+{
+	++m_frame;
+
+	switch( m_workload )
+	{
+	case Workload::Idle:
+		renderIdleFrame( damage );
+		break;
+	case Workload::Scroll:
+		renderScrollFrame( damage, moves );
+		break;
+	case Workload::Drag:
+		renderDragFrame( damage, moves );
+		break;
+	case Workload::Noise:
+		fillNoise( bounds(), mix( m_seed, m_frame ) );
+		damage->add( bounds() );
+		break;
+	case Workload::Replay:
+		renderReplayFrame( damage, moves );
+		break;
+	}
+}
+
+
+
+void SyntheticFramebuffer::renderIdleFrame( Types::Region* damage )
+{
+	if( m_frame % uint32_t(caretBlinkInterval()) )
+	{
+		return;
+	}
+
+	fillCaret( ( m_frame / uint32_t(caretBlinkInterval()) ) % 2 == 0 );
+
+	damage->add( caretRect() );
+}
+
+
+
+void SyntheticFramebuffer::renderScrollFrame( Types::Region* damage, Types::Moves* moves )
+{
+	const Types::Move move( { 0, 0, m_size.width() - 1, m_size.height() - 1 - LineHeight }, 0, -LineHeight );
+	copyArea( move );
+	Types::appendMove( move, damage, moves );
+
+	const auto visibleLines = ( m_size.height() + LineHeight - 1 ) / LineHeight;
+	const auto top = m_size.height() - LineHeight;
+	drawTextLine( top, uint32_t(visibleLines) + m_frame - 1 );
+
+	damage->add( { 0, top, m_size.width() - 1, m_size.height() - 1 } );
+}
+
+
+
+void SyntheticFramebuffer::renderDragFrame( Types::Region* damage, Types::Moves* moves )
+{
+	const auto oldRect = windowRect();
+
+	// bounce off the edges of the framebuffer
+	auto x = m_windowPosition.x() + m_windowVelocityX;
+	auto y = m_windowPosition.y() + m_windowVelocityY;
+	if( x < 0 || x + oldRect.width() > m_size.width() )
+	{
+		m_windowVelocityX = -m_windowVelocityX;
+		x = std::max( 0, std::min( x, m_size.width() - oldRect.width() ) );
+	}
+	if( y < 0 || y + oldRect.height() > m_size.height() )
+	{
+		m_windowVelocityY = -m_windowVelocityY;
+		y = std::max( 0, std::min( y, m_size.height() - oldRect.height() ) );
+	}
+	m_windowPosition = { x, y };
+
+	const auto newRect = windowRect();
+	const Types::Move move( newRect, newRect.left() - oldRect.left(), newRect.top() - oldRect.top() );
+	copyArea( move );
+	Types::appendMove( move, damage, moves );
+
+	// uncover the background where the window has been before
+	std::vector<Types::Rectangle> exposed;
+	if( oldRect.intersects( newRect ) == false )
+	{
+		exposed.push_back( oldRect );
+	}
+	else
+	{
+		if( newRect.top() > oldRect.top() )
+		{
+			exposed.emplace_back( oldRect.left(), oldRect.top(), oldRect.right(), newRect.top() - 1 );
+		}
+		if( newRect.bottom() < oldRect.bottom() )
+		{
+			exposed.emplace_back( oldRect.left(), newRect.bottom() + 1, oldRect.right(), oldRect.bottom() );
+		}
+
+		const auto top = std::max( oldRect.top(), newRect.top() );
+		const auto bottom = std::min( oldRect.bottom(), newRect.bottom() );
+		if( newRect.left() > oldRect.left() )
+		{
+			exposed.emplace_back( oldRect.left(), top, newRect.left() - 1, bottom );
+		}
+		if( newRect.right() < oldRect.right() )
+		{
+			exposed.emplace_back( newRect.right() + 1, top, oldRect.right(), bottom );
+		}
+	}
+
+	for( const auto& rect : exposed )
+	{
+		fillBackground( rect );
+		damage->add( rect );
+	}
+}
+
+
+
+void SyntheticFramebuffer::renderReplayFrame( Types::Region* damage, Types::Moves* moves )
+{
+	uint32_t commandIndex = 0;
+
+	do
+	{
+		const auto& command = m_trace[m_traceIndex];
+		m_traceIndex = ( m_traceIndex + 1 ) % m_trace.size();
+
+		switch( command.type )
+		{
+		case TraceCommand::Type::Fill:
+			fillNoise( command.rect, mix( mix( m_seed, m_frame ), commandIndex ) );
+			damage->add( command.rect );
+			break;
+		case TraceCommand::Type::Copy:
+		{
+			const Types::Move move( command.rect, command.dx, command.dy );
+			copyArea( move );
+			Types::appendMove( move, damage, moves );
+			break;
+		}
+		case TraceCommand::Type::Frame:
+			return;
+		}
+
+		++commandIndex;
+	}
+	while( m_traceIndex != 0 );
+}
+
+
+
+Types::Rectangle SyntheticFramebuffer::bounds() const
+{
+	return { 0, 0, m_size.width() - 1, m_size.height() - 1 };
+}
+
+
+
+Types::Rectangle SyntheticFramebuffer::caretRect() const
+{
+	const auto x = m_size.width() / 2;
+	const auto y = ( m_size.height() - LineHeight ) / 2;
+
+	return { x, y, x + CaretWidth - 1, y + LineHeight - 1 };
+}
+
+
+
+Types::Rectangle SyntheticFramebuffer::windowRect() const
+{
+	const auto width = m_size.width() / 4;
+	const auto height = m_size.height() / 4;
+
+	return { m_windowPosition.x(), m_windowPosition.y(),
+			 m_windowPosition.x() + width - 1, m_windowPosition.y() + height - 1 };
+}
+
+
+
+int SyntheticFramebuffer::caretBlinkInterval() const
+{
+	// twice per second, counted in frames to stay independent of timing
+	static constexpr auto UnpacedBlinkInterval = 15;
+
+	return m_frameRate > 0 ? std::max( m_frameRate / 2, 1 ) : UnpacedBlinkInterval;
+}
+
+
+
+void SyntheticFramebuffer::fillBackground( const Types::Rectangle& rect )
+{
+	static constexpr auto PatternSize = 32;
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		auto line = m_pixels.data() + y * m_size.width();
+		for( int x = rect.left(); x <= rect.right(); ++x )
+		{
+			line[x] = ( ( x / PatternSize + y / PatternSize ) % 2 ) ? BackgroundPatternColor : BackgroundColor;
+		}
+	}
+}
+
+
+
+void SyntheticFramebuffer::fillNoise( const Types::Rectangle& rect, uint32_t seed )
+{
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		auto line = m_pixels.data() + y * m_size.width();
+		auto state = mix( seed, uint32_t(y) ) | 1;
+		for( int x = rect.left(); x <= rect.right(); ++x )
+		{
+			// xorshift32
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			line[x] = state & 0xffffff;
+		}
+	}
+}
+
+
+
+void SyntheticFramebuffer::fillCaret( bool visible )
+{
+	const auto caret = caretRect();
+	if( visible == false )
+	{
+		fillBackground( caret );
+		return;
+	}
+
+	for( int y = caret.top(); y <= caret.bottom(); ++y )
+	{
+		std::fill_n( m_pixels.begin() + y * m_size.width() + caret.left(), caret.width(), CaretColor );
+	}
+}
+
+
+
+void SyntheticFramebuffer::fillWindow( const Types::Rectangle& rect )
+{
+	static constexpr auto TitleBarHeight = 24;
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		std::fill_n( m_pixels.begin() + y * m_size.width() + rect.left(), rect.width(),
+					 y - rect.top() < TitleBarHeight ? WindowTitleColor : WindowColor );
+	}
+}
+
+
+
+void SyntheticFramebuffer::drawTextLine( int top, uint32_t lineNumber )
+{
+	static constexpr auto GlyphMarginTop = 3;
+	static constexpr auto GlyphMarginBottom = 3;
+
+	const auto lineSeed = mix( m_seed, lineNumber );
+	const auto columns = m_size.width() / GlyphWidth;
+	const auto length = int(lineSeed % uint32_t(columns + 1));
+
+	for( int row = 0; row < LineHeight; ++row )
+	{
+		const auto y = top + row;
+		if( y < 0 || y >= m_size.height() )
+		{
+			continue;
+		}
+
+		auto line = m_pixels.data() + y * m_size.width();
+		std::fill_n( line, m_size.width(), TextBackgroundColor );
+
+		if( row < GlyphMarginTop || row >= LineHeight - GlyphMarginBottom )
+		{
+			continue;
+		}
+
+		for( int column = 0; column < length; ++column )
+		{
+			const auto glyph = mix( lineSeed, uint32_t(column) );
+			// some blanks between words
+			if( glyph % 7 == 0 )
+			{
+				continue;
+			}
+
+			for( int x = 0; x < GlyphWidth - 1; ++x )
+			{
+				if( ( glyph >> ( ( row * GlyphWidth + x ) % 32 ) ) & 1 )
+				{
+					line[column * GlyphWidth + x] = TextColor;
+				}
+			}
+		}
+	}
+}
+
+
+
+void SyntheticFramebuffer::copyArea( const Types::Move& move )
+{
+	const auto& destination = move.destination();
+	const auto source = move.source();
+	const auto width = size_t(destination.width());
+
+	// copy in the direction which doesn't overwrite lines not copied yet
+	const auto copyLine = [&]( int row ) {
+		memmove( m_pixels.data() + ( destination.top() + row ) * m_size.width() + destination.left(),
+				 m_pixels.data() + ( source.top() + row ) * m_size.width() + source.left(),
+				 width * sizeof(uint32_t) );
+	};
+
+	if( move.dy() > 0 )
+	{
+		for( int row = destination.height() - 1; row >= 0; --row )
+		{
+			copyLine( row );
+		}
+	}
+	else
+	{
+		for( int row = 0; row < destination.height(); ++row )
+		{
+			copyLine( row );
+		}
+	}
+}
+
+}
+
+ANYVNC_EXPORT_PLUGIN(AnyVnc::SyntheticFramebuffer)
@@ -0,0 +1,182 @@
+/*
+ * SyntheticFramebuffer.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "libanyvnc/interfaces/Framebuffer.h"
+
+namespace AnyVnc
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+// generates reproducible workloads for load testing the server - configured
+// through the following environment variables:
+//
+//   ANYVNC_SYNTHETIC_WORKLOAD    idle (default), scroll, drag, noise or replay
+//   ANYVNC_SYNTHETIC_TRACE       damage trace played back by the replay workload
+//   ANYVNC_SYNTHETIC_RESOLUTION  WIDTHxHEIGHT, defaults to 1920x1080
+//   ANYVNC_SYNTHETIC_RATE        frames per second, 0 renders a frame on every update
+//   ANYVNC_SYNTHETIC_SEED        seed for generated content
+//
+// trace files contain one command per line, '#' starts a comment:
+//
+//   fill X Y WIDTH HEIGHT          paints the area with frame dependent content
+//   copy X Y WIDTH HEIGHT DX DY    copies the area from X-DX/Y-DY
+//   frame                          completes the current frame
+//
+// the trace is repeated once its end is reached
+class SyntheticFramebuffer : public Interfaces::Framebuffer
+{
+public:
+	enum class Workload
+	{
+		Idle,
+		Scroll,
+		Drag,
+		Noise,
+		Replay
+	};
+
+	explicit SyntheticFramebuffer() = default;
+
+	std::string uid() const override
+	{
+		return "8f3a5d2e-6b1c-4e7a-b9d4-2c0f7e1a6b35";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "SyntheticFramebuffer";
+	}
+
+	std::string description() const override
+	{
+		return "Framebuffer with generated or replayed workloads";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	Flags flags() const override
+	{
+		return Flags{ Flag::RequiresExplicitSelection };
+	}
+
+	bool initialize( Core::Server* server ) override;
+
+	void* data() const override;
+	Types::Size size() const override;
+
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
+
+	Types::Screens availableScreens() const override;
+
+private:
+	static constexpr auto DefaultWidth = 1920;
+	static constexpr auto DefaultHeight = 1080;
+	static constexpr auto DefaultFrameRate = 30;
+	static constexpr auto MinimumSize = 64;
+	static constexpr auto MaximumSize = 16384;
+	static constexpr auto LineHeight = 16;
+	static constexpr auto GlyphWidth = 8;
+	static constexpr auto CaretWidth = 2;
+	static constexpr auto WindowVelocityX = 13;
+	static constexpr auto WindowVelocityY = 7;
+	// don't try to catch up with frames missed for longer than this
+	static constexpr auto MaximumFrameLag = std::chrono::seconds(1);
+
+	struct TraceCommand
+	{
+		enum class Type
+		{
+			Fill,
+			Copy,
+			Frame
+		};
+
+		Type type;
+		Types::Rectangle rect;
+		int dx;
+		int dy;
+	};
+
+	bool readConfiguration();
+	bool readTrace( const std::string& fileName );
+
+	void renderInitialFrame();
+	void renderFrame( Types::Region* damage, Types::Moves* moves );
+	void renderIdleFrame( Types::Region* damage );
+	void renderScrollFrame( Types::Region* damage, Types::Moves* moves );
+	void renderDragFrame( Types::Region* damage, Types::Moves* moves );
+	void renderReplayFrame( Types::Region* damage, Types::Moves* moves );
+
+	Types::Rectangle bounds() const;
+	Types::Rectangle caretRect() const;
+	Types::Rectangle windowRect() const;
+	int caretBlinkInterval() const;
+
+	void fillBackground( const Types::Rectangle& rect );
+	void fillNoise( const Types::Rectangle& rect, uint32_t seed );
+	void fillCaret( bool visible );
+	void fillWindow( const Types::Rectangle& rect );
+	void drawTextLine( int top, uint32_t lineNumber );
+	void copyArea( const Types::Move& move );
+
+	Workload m_workload{Workload::Idle};
+	Types::Size m_size{ DefaultWidth, DefaultHeight };
+	int m_frameRate{DefaultFrameRate};
+	uint32_t m_seed{1};
+
+	std::vector<uint32_t> m_pixels;
+	void* m_framebufferData{nullptr};
+
+	uint32_t m_frame{0};
+	std::chrono::steady_clock::time_point m_nextFrameTime{};
+
+	Types::Point m_windowPosition;
+	int m_windowVelocityX{WindowVelocityX};
+	int m_windowVelocityY{WindowVelocityY};
+
+	std::vector<TraceCommand> m_trace;
+	size_t m_traceIndex{0};
+
+};
+
+}
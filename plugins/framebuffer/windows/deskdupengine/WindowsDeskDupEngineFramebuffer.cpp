@@ -22,6 +22,7 @@
  *
  */
 
+#include <algorithm>
 #include <iostream>
 
 #include "WindowsDeskDupEngineFramebuffer.h"
@@ -43,7 +44,15 @@ bool WindowsDeskDupEngineFramebuffer::initialize( Core::Server* server )
 
 	m_deskDupEngine = new DeskDupEngine;
 
-	return m_deskDupEngine->start( false );
+	if( m_deskDupEngine->start( false ) == false )
+	{
+		return false;
+	}
+
+	// keep the cursor out of the framebuffer - it is reported separately
+	m_deskDupEngine->hardwareCursor();
+
+	return true;
 }
 
 
@@ -71,16 +80,29 @@ Types::Size WindowsDeskDupEngineFramebuffer::size() const
 }
 
 
-static void visitChangeRecord( const Interfaces::Framebuffer::RectangleVisitor& visitor,
-					   const DeskDupEngine::ChangesRecord& changesRecord )
+// beyond that, re-encoding the destinations is cheaper than tracking each move
+static constexpr size_t MaxMovesPerUpdate = 64;
+
+
+static void addChangeRecord( Types::Region* damage, Types::Moves* moves, bool* cursorShapeChanged,
+							 const DeskDupEngine::ChangesRecord& changesRecord )
 {
 	const auto& rect = changesRecord.rect;
 
 	switch( DeskDupEngine::Change(changesRecord.type) )
 	{
 	case DeskDupEngine::Change::ScreenToScreen:
-		// TODO
-		std::cout << "ScreenToScreen" << rect.left << rect.top << rect.right << rect.bottom;
+		// rect is the destination and point the top left corner of the source
+		if( moves->size() < MaxMovesPerUpdate )
+		{
+			Types::appendMove( { { rect.left, rect.top, rect.right, rect.bottom },
+								 rect.left - changesRecord.point.x, rect.top - changesRecord.point.y },
+							   damage, moves );
+		}
+		else
+		{
+			damage->add( { rect.left, rect.top, rect.right, rect.bottom } );
+		}
 		break;
 	case DeskDupEngine::Change::SolidFill:
 	case DeskDupEngine::Change::Textout:
@@ -88,11 +110,10 @@ static void visitChangeRecord( const Interfaces::Framebuffer::RectangleVisitor&
 	case DeskDupEngine::Change::Trans:
 	case DeskDupEngine::Change::Plg:
 	case DeskDupEngine::Change::Blit:
-		visitor( { rect.left, rect.top, rect.right, rect.bottom } );
+		damage->add( { rect.left, rect.top, rect.right, rect.bottom } );
 		break;
 	case DeskDupEngine::Change::Pointer:
-		// TODO
-		std::cout << "Pointer" << rect.left << rect.top << rect.right << rect.bottom;
+		*cursorShapeChanged = true;
 		break;
 	case DeskDupEngine::Change::Unknown:
 		std::cout << "unknown DeskDupEngine change type" << changesRecord.type;
@@ -102,16 +123,22 @@ static void visitChangeRecord( const Interfaces::Framebuffer::RectangleVisitor&
 
 
 
-WindowsDeskDupEngineFramebuffer::UpdateFlags WindowsDeskDupEngineFramebuffer::update( const RectangleVisitor& visitor )
+WindowsDeskDupEngineFramebuffer::UpdateFlags WindowsDeskDupEngineFramebuffer::update( Types::Region* damage, Types::Moves* moves )
 {
+	// acknowledge notification before reading the counter so changes arriving
+	// in the meantime signal the event again
+	ResetEvent( m_deskDupEngine->screenEvent() );
+
 	const auto previousCounter = m_deskDupEngine->previousCounter();
 	auto counter = m_deskDupEngine->changesBuffer()->counter;
 
+	bool cursorShapeChanged = false;
+
 	if( previousCounter == counter ||
 		counter < 1 ||
 		counter > DeskDupEngine::MaxChanges )
 	{
-		return UpdateFlags{ UpdateFlag::None };
+		return updateCursor( cursorShapeChanged );
 	}
 
 	const auto* changes = m_deskDupEngine->changesBuffer()->changes;
@@ -120,33 +147,200 @@ WindowsDeskDupEngineFramebuffer::UpdateFlags WindowsDeskDupEngineFramebuffer::up
 	{
 		for( ULONG i = previousCounter+1; i <= counter; ++i )
 		{
-			visitChangeRecord( visitor, changes[i] );
+			addChangeRecord( damage, moves, &cursorShapeChanged, changes[i] );
 		}
 	}
 	else
 	{
 		for( ULONG i = previousCounter + 1; i < DeskDupEngine::MaxChanges; ++i )
 		{
-			visitChangeRecord( visitor, changes[i] );
+			addChangeRecord( damage, moves, &cursorShapeChanged, changes[i] );
 		}
 
 		for( ULONG i = 1; i <= counter; ++i )
 		{
-			visitChangeRecord( visitor, changes[i] );
+			addChangeRecord( damage, moves, &cursorShapeChanged, changes[i] );
 		}
 	}
 
 	m_deskDupEngine->setPreviousCounter( counter );
 
-	return UpdateFlags{ UpdateFlag::None };
+	return updateCursor( cursorShapeChanged );
+}
+
+
+
+static bool readBitmap( HDC dc, HBITMAP bitmap, int width, int height, std::vector<uint32_t>* pixels )
+{
+	BITMAPINFO info{};
+	info.bmiHeader.biSize = sizeof(info.bmiHeader);
+	info.bmiHeader.biWidth = width;
+	info.bmiHeader.biHeight = -height; // top-down
+	info.bmiHeader.biPlanes = 1;
+	info.bmiHeader.biBitCount = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	pixels->resize( size_t(width) * size_t(height) );
+
+	return GetDIBits( dc, bitmap, 0, UINT(height), pixels->data(), &info, DIB_RGB_COLORS ) == height;
+}
+
+
+
+static std::shared_ptr<const Types::Cursor> readCursorShape( HCURSOR cursorHandle )
+{
+	ICONINFO iconInfo{};
+	if( GetIconInfo( cursorHandle, &iconInfo ) == false )
+	{
+		return {};
+	}
+
+	BITMAP maskBitmap{};
+	GetObject( iconInfo.hbmMask, sizeof(maskBitmap), &maskBitmap );
+
+	const auto width = int(maskBitmap.bmWidth);
+	// monochrome cursors stack the AND mask on top of the XOR mask
+	const auto height = iconInfo.hbmColor ? int(maskBitmap.bmHeight) : int(maskBitmap.bmHeight) / 2;
+
+	std::vector<uint32_t> mask;
+	std::vector<uint32_t> color;
+
+	const auto dc = GetDC( nullptr );
+	auto success = readBitmap( dc, iconInfo.hbmMask, width, int(maskBitmap.bmHeight), &mask );
+	if( success && iconInfo.hbmColor )
+	{
+		success = readBitmap( dc, iconInfo.hbmColor, width, height, &color );
+	}
+	ReleaseDC( nullptr, dc );
+
+	DeleteObject( iconInfo.hbmMask );
+	if( iconInfo.hbmColor )
+	{
+		DeleteObject( iconInfo.hbmColor );
+	}
+
+	if( success == false )
+	{
+		return {};
+	}
+
+	std::vector<uint32_t> pixels( size_t(width) * size_t(height) );
+
+	if( color.empty() == false )
+	{
+		const auto hasAlpha = std::any_of( color.begin(), color.end(), []( uint32_t pixel ) { return pixel >> 24; } );
+
+		for( size_t i = 0; i < pixels.size(); ++i )
+		{
+			// cursors without alpha channel are transparent where the AND mask is set
+			pixels[i] = hasAlpha ? color[i] : ( color[i] & 0xffffff ) | ( mask[i] ? 0 : 0xff000000 );
+		}
+	}
+	else
+	{
+		const auto xorMask = mask.data() + pixels.size();
+
+		for( size_t i = 0; i < pixels.size(); ++i )
+		{
+			// AND 1 / XOR 1 inverts the screen which is approximated by black
+			if( mask[i] == 0 || xorMask[i] == 0 )
+			{
+				pixels[i] = mask[i] ? 0x00000000 : 0xff000000 | ( xorMask[i] & 0xffffff );
+			}
+			else
+			{
+				pixels[i] = 0xff000000;
+			}
+		}
+	}
+
+	return std::make_shared<Types::Cursor>( Types::Size{ width, height },
+											Types::Point{ int(iconInfo.xHotspot), int(iconInfo.yHotspot) },
+											std::move(pixels) );
+}
+
+
+
+WindowsDeskDupEngineFramebuffer::UpdateFlags WindowsDeskDupEngineFramebuffer::updateCursor( bool shapeChanged )
+{
+	UpdateFlags flags{ UpdateFlag::None };
+
+	CURSORINFO cursorInfo{};
+	cursorInfo.cbSize = sizeof(cursorInfo);
+	if( GetCursorInfo( &cursorInfo ) == false )
+	{
+		return flags;
+	}
+
+	// framebuffer origin is the top left corner of the virtual screen
+	const Types::Point position{ cursorInfo.ptScreenPos.x - GetSystemMetrics(SM_XVIRTUALSCREEN),
+								 cursorInfo.ptScreenPos.y - GetSystemMetrics(SM_YVIRTUALSCREEN) };
+	if( position.x() != m_cursorPosition.x() || position.y() != m_cursorPosition.y() )
+	{
+		m_cursorPosition = position;
+		flags |= UpdateFlag::CursorMoved;
+	}
+
+	// the engine reports shape changes of the pointer while the handle
+	// changes when applications switch between system cursors
+	const auto visible = ( cursorInfo.flags & CURSOR_SHOWING ) != 0;
+	if( shapeChanged || visible != m_cursorVisible || cursorInfo.hCursor != m_cursorHandle )
+	{
+		m_cursorHandle = cursorInfo.hCursor;
+		m_cursorVisible = visible;
+		m_cursorShape = visible ? readCursorShape( cursorInfo.hCursor ) : nullptr;
+		flags |= UpdateFlag::CursorShapeChanged;
+	}
+
+	return flags;
+}
+
+
+
+Types::EventHandle WindowsDeskDupEngineFramebuffer::damageEvent() const
+{
+	if( m_deskDupEngine )
+	{
+		return m_deskDupEngine->screenEvent();
+	}
+
+	return Types::InvalidEventHandle;
+}
+
+
+
+static BOOL CALLBACK addMonitorScreen( HMONITOR monitor, HDC, LPRECT, LPARAM data )
+{
+	MONITORINFO monitorInfo{};
+	monitorInfo.cbSize = sizeof(monitorInfo);
+
+	if( GetMonitorInfo( monitor, &monitorInfo ) )
+	{
+		// framebuffer origin is the top left corner of the virtual screen
+		const auto& rect = monitorInfo.rcMonitor;
+		reinterpret_cast<Types::Screens *>( data )->emplace_back(
+			Types::Size{ rect.right - rect.left, rect.bottom - rect.top }, 32,
+			Types::Point{ rect.left - GetSystemMetrics(SM_XVIRTUALSCREEN),
+						  rect.top - GetSystemMetrics(SM_YVIRTUALSCREEN) } );
+	}
+
+	return TRUE;
 }
 
 
 
 Types::Screens WindowsDeskDupEngineFramebuffer::availableScreens() const
 {
-	// TODO: multi monitor support
-	return { Types::Screen { size(), 32 } };
+	Types::Screens screens;
+
+	EnumDisplayMonitors( nullptr, nullptr, addMonitorScreen, LPARAM(&screens) );
+
+	if( screens.empty() )
+	{
+		return { Types::Screen { size(), 32 } };
+	}
+
+	return screens;
 }
 
 }
@@ -77,14 +77,33 @@ public:
 	void* data() const override;
 	Types::Size size() const override;
 
-	UpdateFlags update( const RectangleVisitor& visitor ) override;
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
 
 	Types::Screens availableScreens() const override;
 
+	std::shared_ptr<const Types::Cursor> cursorShape() const override
+	{
+		return m_cursorShape;
+	}
+
+	Types::Point cursorPosition() const override
+	{
+		return m_cursorPosition;
+	}
+
+	Types::EventHandle damageEvent() const override;
+
 private:
+	UpdateFlags updateCursor( bool shapeChanged );
+
 	Core::Server* m_server{nullptr};
 	DeskDupEngine* m_deskDupEngine{nullptr};
 
+	std::shared_ptr<const Types::Cursor> m_cursorShape;
+	Types::Point m_cursorPosition;
+	void* m_cursorHandle{nullptr};
+	bool m_cursorVisible{false};
+
 };
 
 }
@@ -0,0 +1,577 @@
+/*
+ * X11Framebuffer.cpp
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "X11Framebuffer.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#ifdef ANYVNC_HAVE_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
+#ifdef ANYVNC_HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif
+
+namespace AnyVnc
+{
+
+struct X11Framebuffer::SharedImage
+{
+	XImage* image{nullptr};
+	XShmSegmentInfo segment{};
+};
+
+
+
+static int handleXError( Display* display, XErrorEvent* event )
+{
+	// the default handler terminates the process, e.g. when fetching an
+	// area while the screen is being resized
+	std::array<char, 256> message{};
+	XGetErrorText( display, event->error_code, message.data(), int(message.size()) );
+	std::cerr << "X11Framebuffer: X error: " << message.data() << std::endl;
+
+	return 0;
+}
+
+
+
+static int maskShift( unsigned long mask )
+{
+	int shift = 0;
+	while( mask && ( mask & 1 ) == 0 )
+	{
+		mask >>= 1;
+		++shift;
+	}
+
+	return shift;
+}
+
+
+
+X11Framebuffer::~X11Framebuffer()
+{
+	if( m_display == nullptr )
+	{
+		return;
+	}
+
+#ifdef ANYVNC_HAVE_XDAMAGE
+	if( m_damageAvailable )
+	{
+		XDamageDestroy( m_notificationDisplay, m_damage );
+		XFixesDestroyRegion( m_display, m_damageRegion );
+	}
+#endif
+
+	destroyImage();
+
+	if( m_notificationDisplay )
+	{
+		XCloseDisplay( m_notificationDisplay );
+	}
+
+	XCloseDisplay( m_display );
+}
+
+
+
+bool X11Framebuffer::initialize( Core::Server* )
+{
+	m_display = XOpenDisplay( nullptr );
+	if( m_display == nullptr )
+	{
+		std::cerr << "X11Framebuffer: could not open display" << std::endl;
+		return false;
+	}
+
+	XSetErrorHandler( handleXError );
+
+	int major = 0;
+	int minor = 0;
+	Bool sharedPixmaps = False;
+	if( XShmQueryVersion( m_display, &major, &minor, &sharedPixmaps ) == False )
+	{
+		std::cerr << "X11Framebuffer: MIT-SHM extension not available" << std::endl;
+		return false;
+	}
+
+	m_rootWindow = DefaultRootWindow( m_display );
+
+	if( createImage() == false )
+	{
+		return false;
+	}
+
+#ifdef ANYVNC_HAVE_XFIXES
+	int errorBase = 0;
+	m_fixesAvailable = XFixesQueryExtension( m_display, &m_fixesEventBase, &errorBase );
+#endif
+
+#ifdef ANYVNC_HAVE_XDAMAGE
+	int eventBase = 0;
+	if( m_fixesAvailable && XDamageQueryExtension( m_display, &eventBase, &errorBase ) )
+	{
+		m_notificationDisplay = XOpenDisplay( DisplayString( m_display ) );
+	}
+
+	if( m_notificationDisplay )
+	{
+		// extension events are only decoded on connections the extension has been queried on
+		XFixesQueryExtension( m_notificationDisplay, &eventBase, &errorBase );
+		XDamageQueryExtension( m_notificationDisplay, &eventBase, &errorBase );
+
+		m_damage = XDamageCreate( m_notificationDisplay, m_rootWindow, XDamageReportNonEmpty );
+		m_damageRegion = XFixesCreateRegion( m_display, nullptr, 0 );
+		m_damageAvailable = true;
+	}
+#endif
+
+	const auto display = eventDisplay();
+
+	// get notified about resolution changes through ConfigureNotify
+	XSelectInput( display, m_rootWindow, StructureNotifyMask );
+
+#ifdef ANYVNC_HAVE_XFIXES
+	if( m_fixesAvailable )
+	{
+		XFixesSelectCursorInput( display, m_rootWindow, XFixesDisplayCursorNotifyMask );
+	}
+#endif
+
+	// the damage object has to exist before the main connection refers to it
+	XSync( display, False );
+
+#ifdef ANYVNC_HAVE_XDAMAGE
+	if( m_damageAvailable )
+	{
+		// report everything as damaged once so the first update fetches the whole
+		// screen without waiting for something to change
+		XRectangle screen{ 0, 0, static_cast<unsigned short>( m_size.width() ), static_cast<unsigned short>( m_size.height() ) };
+		const auto screenRegion = XFixesCreateRegion( m_display, &screen, 1 );
+		XDamageAdd( m_display, m_rootWindow, screenRegion );
+		XFixesDestroyRegion( m_display, screenRegion );
+		XFlush( m_display );
+	}
+#endif
+
+	if( m_damageAvailable == false )
+	{
+		std::cerr << "X11Framebuffer: XDamage extension not available, comparing tiles instead" << std::endl;
+	}
+
+	return true;
+}
+
+
+
+void* X11Framebuffer::data() const
+{
+	return m_image ? m_image->image->data : nullptr;
+}
+
+
+
+Types::Size X11Framebuffer::size() const
+{
+	return m_size;
+}
+
+
+
+Types::PixelFormat X11Framebuffer::pixelFormat() const
+{
+	return m_pixelFormat;
+}
+
+
+
+int X11Framebuffer::bytesPerLine() const
+{
+	return m_image ? m_image->image->bytes_per_line : 0;
+}
+
+
+
+X11Framebuffer::UpdateFlags X11Framebuffer::update( Types::Region* damage, Types::Moves* )
+{
+	UpdateFlags flags{};
+
+	bool sizeChanged = false;
+	bool cursorShapeChanged = false;
+	processEvents( &sizeChanged, &cursorShapeChanged );
+
+	if( sizeChanged )
+	{
+		destroyImage();
+		if( createImage() == false )
+		{
+			return UpdateFlags{ UpdateFlag::RequiresRestart };
+		}
+
+		flags |= UpdateFlag::SizeChanged;
+	}
+
+	const Types::Rectangle bounds{ 0, 0, m_size.width() - 1, m_size.height() - 1 };
+	const auto area = m_captureArea.isValid() ? m_captureArea.intersected( bounds ) : bounds;
+
+	if( area.isEmpty() == false )
+	{
+		if( m_damageAvailable && m_fullCaptureRequired == false )
+		{
+			Types::Region dirtyRegion;
+			readDamage( &dirtyRegion );
+			dirtyRegion = dirtyRegion.intersected( area );
+
+			// the X server derives the line length from the image width so only
+			// full-width stripes can be fetched into the shared image
+			std::vector<std::pair<int, int>> stripes;
+			for( const auto& rect : dirtyRegion.rectangles() )
+			{
+				if( stripes.empty() == false && rect.top() <= stripes.back().second + 1 )
+				{
+					stripes.back().second = std::max( stripes.back().second, rect.bottom() );
+				}
+				else
+				{
+					stripes.emplace_back( rect.top(), rect.bottom() );
+				}
+			}
+
+			for( const auto& stripe : stripes )
+			{
+				captureRows( stripe.first, stripe.second );
+			}
+
+			damage->add( dirtyRegion );
+		}
+		else
+		{
+			captureRows( area.top(), area.bottom() );
+
+			if( m_damageAvailable )
+			{
+				// everything has been fetched anyway
+				Types::Region discardedDamage;
+				readDamage( &discardedDamage );
+				damage->add( area );
+			}
+			else
+			{
+				Types::Region changedRegion;
+				m_damageDetector.detect( data(), m_size, bytesPerLine(), m_pixelFormat.bytesPerPixel(), &changedRegion );
+				damage->add( changedRegion.intersected( area ) );
+			}
+
+			m_fullCaptureRequired = false;
+		}
+	}
+
+	flags |= updateCursor( cursorShapeChanged );
+
+	return flags;
+}
+
+
+
+Types::Screens X11Framebuffer::availableScreens() const
+{
+	return { Types::Screen{ m_size, m_depth } };
+}
+
+
+
+Types::EventHandle X11Framebuffer::damageEvent() const
+{
+	// without XDamage the whole capture area is compared on each update so it has to be polled
+	return m_notificationDisplay ? ConnectionNumber( m_notificationDisplay ) : Types::InvalidEventHandle;
+}
+
+
+
+void X11Framebuffer::setCaptureArea( Types::Rectangle area )
+{
+	if( area != m_captureArea )
+	{
+		// damage outside the previous area has not been fetched
+		m_captureArea = area;
+		m_fullCaptureRequired = true;
+	}
+}
+
+
+
+bool X11Framebuffer::createImage()
+{
+	XWindowAttributes attributes{};
+	if( XGetWindowAttributes( m_display, m_rootWindow, &attributes ) == 0 )
+	{
+		return false;
+	}
+
+	const auto visual = attributes.visual;
+	if( visual->c_class != TrueColor )
+	{
+		std::cerr << "X11Framebuffer: only TrueColor visuals are supported" << std::endl;
+		return false;
+	}
+
+	auto sharedImage = std::make_unique<SharedImage>();
+	auto& segment = sharedImage->segment;
+
+	auto image = XShmCreateImage( m_display, visual, unsigned(attributes.depth), ZPixmap, nullptr, &segment,
+								  unsigned(attributes.width), unsigned(attributes.height) );
+	if( image == nullptr )
+	{
+		return false;
+	}
+
+	sharedImage->image = image;
+
+	segment.shmid = shmget( IPC_PRIVATE, size_t(image->bytes_per_line) * size_t(image->height), IPC_CREAT | 0600 );
+	if( segment.shmid < 0 )
+	{
+		XDestroyImage( image );
+		return false;
+	}
+
+	segment.shmaddr = image->data = static_cast<char *>( shmat( segment.shmid, nullptr, 0 ) );
+	segment.readOnly = False;
+
+	const auto attached = segment.shmaddr != reinterpret_cast<char *>( -1 ) &&
+						  XShmAttach( m_display, &segment );
+	XSync( m_display, False );
+
+	// removed as soon as the X server and we have detached
+	shmctl( segment.shmid, IPC_RMID, nullptr );
+
+	if( attached == false )
+	{
+		if( segment.shmaddr != reinterpret_cast<char *>( -1 ) )
+		{
+			shmdt( segment.shmaddr );
+		}
+		XDestroyImage( image );
+		return false;
+	}
+
+	m_size = { attributes.width, attributes.height };
+	m_depth = attributes.depth;
+	m_pixelFormat = {
+		image->bits_per_pixel, attributes.depth,
+		int(visual->red_mask >> maskShift( visual->red_mask )),
+		int(visual->green_mask >> maskShift( visual->green_mask )),
+		int(visual->blue_mask >> maskShift( visual->blue_mask )),
+		maskShift( visual->red_mask ),
+		maskShift( visual->green_mask ),
+		maskShift( visual->blue_mask )
+	};
+
+	m_image = std::move(sharedImage);
+	m_fullCaptureRequired = true;
+	m_damageDetector.reset();
+
+	return true;
+}
+
+
+
+void X11Framebuffer::destroyImage()
+{
+	if( m_image == nullptr )
+	{
+		return;
+	}
+
+	XShmDetach( m_display, &m_image->segment );
+	XSync( m_display, False );
+
+	shmdt( m_image->segment.shmaddr );
+
+	// only frees the XImage structure for shared memory images
+	XDestroyImage( m_image->image );
+
+	m_image.reset();
+}
+
+
+
+bool X11Framebuffer::captureRows( int top, int bottom )
+{
+	// an image header for the stripe within the shared memory segment
+	auto stripe = *m_image->image;
+	stripe.height = bottom - top + 1;
+	stripe.data += size_t(top) * size_t(stripe.bytes_per_line);
+
+	return XShmGetImage( m_display, m_rootWindow, &stripe, 0, top, AllPlanes );
+}
+
+
+
+void X11Framebuffer::processEvents( bool* sizeChanged, bool* cursorShapeChanged )
+{
+	// damage notifications are drained only as damage is fetched on each update
+	// - XPending() reads whatever has arrived without waiting for a reply, so
+	// notifications arriving afterwards leave the connection readable
+	const auto display = eventDisplay();
+	while( XPending( display ) > 0 )
+	{
+		XEvent event;
+		XNextEvent( display, &event );
+
+		if( event.type == ConfigureNotify && event.xconfigure.window == Window(m_rootWindow) )
+		{
+			*sizeChanged |= event.xconfigure.width != m_size.width() ||
+							event.xconfigure.height != m_size.height();
+		}
+#ifdef ANYVNC_HAVE_XFIXES
+		else if( m_fixesAvailable && event.type == m_fixesEventBase + XFixesCursorNotify )
+		{
+			*cursorShapeChanged = true;
+		}
+#endif
+	}
+}
+
+
+
+_XDisplay* X11Framebuffer::eventDisplay() const
+{
+	return m_notificationDisplay ? m_notificationDisplay : m_display;
+}
+
+
+
+void X11Framebuffer::readDamage( Types::Region* damage )
+{
+#ifdef ANYVNC_HAVE_XDAMAGE
+	// move the accumulated damage into our region object and reset it atomically
+	XDamageSubtract( m_display, m_damage, None, m_damageRegion );
+
+	int count = 0;
+	const auto rects = XFixesFetchRegion( m_display, m_damageRegion, &count );
+	if( rects == nullptr )
+	{
+		return;
+	}
+
+	for( int i = 0; i < count; ++i )
+	{
+		damage->add( { rects[i].x, rects[i].y, rects[i].x + rects[i].width - 1, rects[i].y + rects[i].height - 1 } );
+	}
+
+	XFree( rects );
+#else
+	// only used if XDamage is available
+	damage->clear();
+#endif
+}
+
+
+
+X11Framebuffer::UpdateFlags X11Framebuffer::updateCursor( bool shapeChanged )
+{
+	UpdateFlags flags{};
+
+	Window root;
+	Window child;
+	int rootX = 0;
+	int rootY = 0;
+	int windowX = 0;
+	int windowY = 0;
+	unsigned int mask = 0;
+
+	if( XQueryPointer( m_display, m_rootWindow, &root, &child, &rootX, &rootY, &windowX, &windowY, &mask ) &&
+		( rootX != m_cursorPosition.x() || rootY != m_cursorPosition.y() ) )
+	{
+		m_cursorPosition = { rootX, rootY };
+		flags |= UpdateFlag::CursorMoved;
+	}
+
+	if( m_fixesAvailable && ( shapeChanged || m_cursorShapeValid == false ) )
+	{
+		m_cursorShape = readCursorShape();
+		m_cursorShapeValid = true;
+		flags |= UpdateFlag::CursorShapeChanged;
+	}
+
+	return flags;
+}
+
+
+
+std::shared_ptr<const Types::Cursor> X11Framebuffer::readCursorShape()
+{
+#ifdef ANYVNC_HAVE_XFIXES
+	const auto image = XFixesGetCursorImage( m_display );
+	if( image == nullptr )
+	{
+		return {};
+	}
+
+	std::vector<uint32_t> pixels( size_t(image->width) * size_t(image->height) );
+
+	for( size_t i = 0; i < pixels.size(); ++i )
+	{
+		// XFixes delivers premultiplied ARGB pixels in unsigned longs
+		const auto pixel = uint32_t(image->pixels[i]);
+		const auto alpha = pixel >> 24;
+		if( alpha == 0 )
+		{
+			continue;
+		}
+
+		const auto unpremultiply = [alpha]( uint32_t value ) {
+			return std::min<uint32_t>( 255, ( value * 255 + alpha / 2 ) / alpha );
+		};
+
+		pixels[i] = alpha << 24 |
+				unpremultiply( ( pixel >> 16 ) & 0xff ) << 16 |
+				unpremultiply( ( pixel >> 8 ) & 0xff ) << 8 |
+				unpremultiply( pixel & 0xff );
+	}
+
+	auto cursor = std::make_shared<Types::Cursor>( Types::Size{ image->width, image->height },
+												   Types::Point{ image->xhot, image->yhot },
+												   std::move(pixels) );
+	XFree( image );
+
+	return cursor;
+#else
+	return {};
+#endif
+}
+
+}
+
+ANYVNC_EXPORT_PLUGIN(AnyVnc::X11Framebuffer)
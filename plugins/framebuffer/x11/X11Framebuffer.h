@@ -0,0 +1,144 @@
+/*
+ * X11Framebuffer.h
+ *
+ * Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of AnyVNC - https://anyvnc.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "libanyvnc/core/TileDamageDetector.h"
+#include "libanyvnc/interfaces/Framebuffer.h"
+
+struct _XDisplay;
+
+namespace AnyVnc
+{
+
+// clazy:excludeall=copyable-polymorphic
+
+class X11Framebuffer : public Interfaces::Framebuffer
+{
+public:
+	explicit X11Framebuffer() = default;
+	~X11Framebuffer() override;
+
+	std::string uid() const override
+	{
+		return "c4e1f6a2-3b7d-4f0e-9a52-8d1b6e7f2a91";
+	}
+
+	Types::VersionNumber version() const override
+	{
+		return { 1, 0 };
+	}
+
+	std::string name() const override
+	{
+		return "X11Framebuffer";
+	}
+
+	std::string description() const override
+	{
+		return "X11 framebuffer using MIT-SHM and XDamage";
+	}
+
+	std::string vendor() const override
+	{
+		return "AnyVNC Community";
+	}
+
+	std::string copyright() const override
+	{
+		return "Tobias Junghans";
+	}
+
+	Flags flags() const override
+	{
+		return Flags{ Flag::ProvidesDefaultImplementation };
+	}
+
+	bool initialize( Core::Server* server ) override;
+
+	void* data() const override;
+	Types::Size size() const override;
+	Types::PixelFormat pixelFormat() const override;
+	int bytesPerLine() const override;
+
+	UpdateFlags update( Types::Region* damage, Types::Moves* moves ) override;
+
+	Types::Screens availableScreens() const override;
+
+	void setCaptureArea( Types::Rectangle area ) override;
+
+	Types::EventHandle damageEvent() const override;
+
+	std::shared_ptr<const Types::Cursor> cursorShape() const override
+	{
+		return m_cursorShape;
+	}
+
+	Types::Point cursorPosition() const override
+	{
+		return m_cursorPosition;
+	}
+
+private:
+	struct SharedImage;
+
+	bool createImage();
+	void destroyImage();
+	bool captureRows( int top, int bottom );
+	_XDisplay* eventDisplay() const;
+	void processEvents( bool* sizeChanged, bool* cursorShapeChanged );
+	void readDamage( Types::Region* damage );
+	UpdateFlags updateCursor( bool shapeChanged );
+	std::shared_ptr<const Types::Cursor> readCursorShape();
+
+	_XDisplay* m_display{nullptr};
+	// receives the notifications only - being never used for round trips,
+	// no notification can end up in Xlib's queue without it turning readable
+	_XDisplay* m_notificationDisplay{nullptr};
+	unsigned long m_rootWindow{0};
+	std::unique_ptr<SharedImage> m_image;
+	Types::Size m_size{};
+	int m_depth{0};
+	Types::PixelFormat m_pixelFormat{Types::PixelFormat::xrgb8888()};
+	Types::Rectangle m_captureArea{};
+	bool m_fullCaptureRequired{true};
+
+	// XDamage reports which areas have to be fetched at all - without it the
+	// whole capture area is fetched and compared on each update
+	bool m_damageAvailable{false};
+	unsigned long m_damage{0};
+	unsigned long m_damageRegion{0};
+	Core::TileDamageDetector m_damageDetector;
+
+	bool m_fixesAvailable{false};
+	int m_fixesEventBase{0};
+	std::shared_ptr<const Types::Cursor> m_cursorShape;
+	Types::Point m_cursorPosition;
+	bool m_cursorShapeValid{false};
+
+};
+
+}
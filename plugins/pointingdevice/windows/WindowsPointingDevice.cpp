@@ -108,12 +108,12 @@ void WindowsPointingDevice::scrollDown()
 
 void WindowsPointingDevice::mouseEvent( int flags, int wheelDelta )
 {
-	// TODO: multi-monitor support
-	auto screen = m_server->framebuffer()->availableScreens().at(0);
+	// positions are relative to the virtual desktop spanning all screens
+	const auto size = m_server->framebuffer()->size();
 
-	::mouse_event( DWORD(MOUSEEVENTF_ABSOLUTE | flags),
-				   DWORD(m_pos.x() * 65535 / screen.geometry().width()),
-				   DWORD(m_pos.y() * 65535 / screen.geometry().height()),
+	::mouse_event( DWORD(MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK | flags),
+				   DWORD(m_pos.x() * 65535 / size.width()),
+				   DWORD(m_pos.y() * 65535 / size.height()),
 				   DWORD(wheelDelta),
 				   0 );
 }
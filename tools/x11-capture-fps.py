@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+#
+# x11-capture-fps.py - measures capture frame rate and CPU usage of the X11 framebuffer
+#
+# Copyright (c) 2020 Tobias Junghans <tobydox@veyon.io>
+#
+# This file is part of AnyVNC - https://anyvnc.com
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public
+# License along with this program (see COPYING); if not, write to the
+# Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+# Boston, MA 02111-1307, USA.
+#
+
+# Starts Xvfb for each resolution, keeps the whole screen changing with
+# xsetroot and serves it with anyvnc-cli using the X11 framebuffer. A minimal
+# RFB client requests updates back to back and counts the updates it receives
+# - each of them needed a capture of changed content. CPU usage is the user
+# and system time anyvnc-cli consumed during the measurement.
+#
+#   tools/x11-capture-fps.py --cli build/apps/cli/anyvnc-cli 1920x1080 3840x2160
+#
+# Requires Xvfb (with MIT-SHM, XDAMAGE and XFIXES, which it provides by
+# default) and xsetroot.
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+VNC_PORT = 5900
+PASSWORD = "anyvnc"
+
+#
+# DES as used by VNC authentication (the standard library has no DES)
+#
+
+PC1 = [57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18, 10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+	   63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22, 14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4]
+PC2 = [14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10, 23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+	   41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48, 44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32]
+SHIFTS = [1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1]
+IP = [58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4, 62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+	  57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3, 61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7]
+FP = [40, 8, 48, 16, 56, 24, 64, 32, 39, 7, 47, 15, 55, 23, 63, 31, 38, 6, 46, 14, 54, 22, 62, 30, 37, 5, 45, 13, 53, 21, 61, 29,
+	  36, 4, 44, 12, 52, 20, 60, 28, 35, 3, 43, 11, 51, 19, 59, 27, 34, 2, 42, 10, 50, 18, 58, 26, 33, 1, 41, 9, 49, 17, 57, 25]
+E = [32, 1, 2, 3, 4, 5, 4, 5, 6, 7, 8, 9, 8, 9, 10, 11, 12, 13, 12, 13, 14, 15, 16, 17,
+	 16, 17, 18, 19, 20, 21, 20, 21, 22, 23, 24, 25, 24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32, 1]
+P = [16, 7, 20, 21, 29, 12, 28, 17, 1, 15, 23, 26, 5, 18, 31, 10, 2, 8, 24, 14, 32, 27, 3, 9, 19, 13, 30, 6, 22, 11, 4, 25]
+SBOXES = [
+	[14, 4, 13, 1, 2, 15, 11, 8, 3, 10, 6, 12, 5, 9, 0, 7, 0, 15, 7, 4, 14, 2, 13, 1, 10, 6, 12, 11, 9, 5, 3, 8,
+	 4, 1, 14, 8, 13, 6, 2, 11, 15, 12, 9, 7, 3, 10, 5, 0, 15, 12, 8, 2, 4, 9, 1, 7, 5, 11, 3, 14, 10, 0, 6, 13],
+	[15, 1, 8, 14, 6, 11, 3, 4, 9, 7, 2, 13, 12, 0, 5, 10, 3, 13, 4, 7, 15, 2, 8, 14, 12, 0, 1, 10, 6, 9, 11, 5,
+	 0, 14, 7, 11, 10, 4, 13, 1, 5, 8, 12, 6, 9, 3, 2, 15, 13, 8, 10, 1, 3, 15, 4, 2, 11, 6, 7, 12, 0, 5, 14, 9],
+	[10, 0, 9, 14, 6, 3, 15, 5, 1, 13, 12, 7, 11, 4, 2, 8, 13, 7, 0, 9, 3, 4, 6, 10, 2, 8, 5, 14, 12, 11, 15, 1,
+	 13, 6, 4, 9, 8, 15, 3, 0, 11, 1, 2, 12, 5, 10, 14, 7, 1, 10, 13, 0, 6, 9, 8, 7, 4, 15, 14, 3, 11, 5, 2, 12],
+	[7, 13, 14, 3, 0, 6, 9, 10, 1, 2, 8, 5, 11, 12, 4, 15, 13, 8, 11, 5, 6, 15, 0, 3, 4, 7, 2, 12, 1, 10, 14, 9,
+	 10, 6, 9, 0, 12, 11, 7, 13, 15, 1, 3, 14, 5, 2, 8, 4, 3, 15, 0, 6, 10, 1, 13, 8, 9, 4, 5, 11, 12, 7, 2, 14],
+	[2, 12, 4, 1, 7, 10, 11, 6, 8, 5, 3, 15, 13, 0, 14, 9, 14, 11, 2, 12, 4, 7, 13, 1, 5, 0, 15, 10, 3, 9, 8, 6,
+	 4, 2, 1, 11, 10, 13, 7, 8, 15, 9, 12, 5, 6, 3, 0, 14, 11, 8, 12, 7, 1, 14, 2, 13, 6, 15, 0, 9, 10, 4, 5, 3],
+	[12, 1, 10, 15, 9, 2, 6, 8, 0, 13, 3, 4, 14, 7, 5, 11, 10, 15, 4, 2, 7, 12, 9, 5, 6, 1, 13, 14, 0, 11, 3, 8,
+	 9, 14, 15, 5, 2, 8, 12, 3, 7, 0, 4, 10, 1, 13, 11, 6, 4, 3, 2, 12, 9, 5, 15, 10, 11, 14, 1, 7, 6, 0, 8, 13],
+	[4, 11, 2, 14, 15, 0, 8, 13, 3, 12, 9, 7, 5, 10, 6, 1, 13, 0, 11, 7, 4, 9, 1, 10, 14, 3, 5, 12, 2, 15, 8, 6,
+	 1, 4, 11, 13, 12, 3, 7, 14, 10, 15, 6, 8, 0, 5, 9, 2, 6, 11, 13, 8, 1, 4, 10, 7, 9, 5, 0, 15, 14, 2, 3, 12],
+	[13, 2, 8, 4, 6, 15, 11, 1, 10, 9, 3, 14, 5, 0, 12, 7, 1, 15, 13, 8, 10, 3, 7, 4, 12, 5, 6, 11, 0, 14, 9, 2,
+	 7, 11, 4, 1, 9, 12, 14, 2, 0, 6, 10, 13, 15, 3, 5, 8, 2, 1, 14, 7, 4, 10, 8, 13, 15, 12, 9, 0, 3, 5, 6, 11],
+]
+
+
+def permute(value, table, width):
+	result = 0
+	for position in table:
+		result = (result << 1) | ((value >> (width - position)) & 1)
+	return result
+
+
+def des_encrypt(key, block):
+	key = permute(int.from_bytes(key, "big"), PC1, 64)
+	left, right = key >> 28, key & 0xfffffff
+	subkeys = []
+	for shift in SHIFTS:
+		left = ((left << shift) | (left >> (28 - shift))) & 0xfffffff
+		right = ((right << shift) | (right >> (28 - shift))) & 0xfffffff
+		subkeys.append(permute((left << 28) | right, PC2, 56))
+
+	block = permute(int.from_bytes(block, "big"), IP, 64)
+	left, right = block >> 32, block & 0xffffffff
+	for subkey in subkeys:
+		expanded = permute(right, E, 32) ^ subkey
+		output = 0
+		for i, sbox in enumerate(SBOXES):
+			bits = (expanded >> (42 - 6 * i)) & 0x3f
+			row = ((bits & 0x20) >> 4) | (bits & 1)
+			column = (bits >> 1) & 0xf
+			output = (output << 4) | sbox[row * 16 + column]
+		left, right = right, left ^ permute(output, P, 32)
+
+	return permute((right << 32) | left, FP, 64).to_bytes(8, "big")
+
+
+def vnc_auth_response(password, challenge):
+	# VNC uses the password bytes with their bit order reversed as DES key
+	key = bytes(int(f"{byte:08b}"[::-1], 2) for byte in password.encode()[:8].ljust(8, b"\0"))
+	return des_encrypt(key, challenge[:8]) + des_encrypt(key, challenge[8:])
+
+
+#
+# minimal RFB client requesting raw updates back to back
+#
+
+class RfbClient:
+	def __init__(self, port, password):
+		self.socket = socket.create_connection(("127.0.0.1", port))
+		self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+		self.receive(12)
+		self.socket.sendall(b"RFB 003.008\n")
+
+		securityTypes = self.receive(self.receive(1)[0])
+		if 2 in securityTypes:
+			self.socket.sendall(b"\x02")
+			self.socket.sendall(vnc_auth_response(password, self.receive(16)))
+		elif 1 in securityTypes:
+			self.socket.sendall(b"\x01")
+		else:
+			raise RuntimeError("no supported security type")
+
+		if struct.unpack(">I", self.receive(4))[0] != 0:
+			raise RuntimeError("authentication failed")
+
+		# shared session
+		self.socket.sendall(b"\x01")
+
+		self.width, self.height = struct.unpack(">HH", self.receive(4))
+		self.bytesPerPixel = self.receive(16)[0] // 8
+		self.receive(struct.unpack(">I", self.receive(4))[0])
+
+		# raw encoding only
+		self.socket.sendall(struct.pack(">BxHi", 2, 1, 0))
+
+	def receive(self, size):
+		data = bytearray()
+		while len(data) < size:
+			chunk = self.socket.recv(min(size - len(data), 1 << 20))
+			if not chunk:
+				raise RuntimeError("connection closed")
+			data += chunk
+		return bytes(data)
+
+	def request_update(self, incremental):
+		self.socket.sendall(struct.pack(">BBHHHH", 3, 1 if incremental else 0, 0, 0, self.width, self.height))
+
+	def read_update(self):
+		# returns the number of pixels of the next framebuffer update
+		while True:
+			messageType = self.receive(1)[0]
+			if messageType == 0:
+				rectangleCount = struct.unpack(">xH", self.receive(3))[0]
+				pixels = 0
+				for _ in range(rectangleCount):
+					_, _, width, height, encoding = struct.unpack(">HHHHi", self.receive(12))
+					if encoding != 0:
+						raise RuntimeError(f"unexpected encoding {encoding}")
+					self.receive(width * height * self.bytesPerPixel)
+					pixels += width * height
+				return pixels
+			elif messageType == 1:
+				colourCount = struct.unpack(">xHH", self.receive(5))[1]
+				self.receive(colourCount * 6)
+			elif messageType == 2:
+				pass
+			elif messageType == 3:
+				self.receive(struct.unpack(">xxxI", self.receive(7))[0])
+			else:
+				raise RuntimeError(f"unexpected message type {messageType}")
+
+
+def cpu_seconds(pid):
+	with open(f"/proc/{pid}/stat") as stat:
+		fields = stat.read().rsplit(")", 1)[1].split()
+	# utime and stime are fields 14 and 15 of stat
+	return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def change_screen(display, stop):
+	# alternating root window colours damage the whole screen
+	environment = dict(os.environ, DISPLAY=display)
+	colours = ["#204a87", "#4e9a06"]
+	frame = 0
+	while not stop.is_set():
+		subprocess.run(["xsetroot", "-solid", colours[frame % 2]], env=environment, check=False)
+		frame += 1
+
+
+def wait_for_port(port, timeout):
+	deadline = time.monotonic() + timeout
+	while time.monotonic() < deadline:
+		try:
+			socket.create_connection(("127.0.0.1", port)).close()
+			return True
+		except OSError:
+			time.sleep(0.1)
+	return False
+
+
+def measure(cli, resolution, display, duration):
+	xvfb = subprocess.Popen(["Xvfb", display, "-screen", "0", f"{resolution}x24", "-nolisten", "tcp"],
+							stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	server = None
+	stop = threading.Event()
+	changer = threading.Thread(target=change_screen, args=(display, stop))
+
+	try:
+		time.sleep(1)
+		server = subprocess.Popen([cli, "--framebuffer", "X11Framebuffer", PASSWORD],
+								  env=dict(os.environ, DISPLAY=display),
+								  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+		if not wait_for_port(VNC_PORT, 10):
+			raise RuntimeError("anyvnc-cli did not start listening")
+
+		client = RfbClient(VNC_PORT, PASSWORD)
+		client.request_update(False)
+		client.read_update()
+
+		changer.start()
+
+		updates = 0
+		pixels = 0
+		startCpu = cpu_seconds(server.pid)
+		start = time.monotonic()
+		while time.monotonic() - start < duration:
+			client.request_update(True)
+			pixels += client.read_update()
+			updates += 1
+		elapsed = time.monotonic() - start
+		cpu = cpu_seconds(server.pid) - startCpu
+
+		print(f"{resolution}: {updates / elapsed:.1f} fps, {pixels / elapsed / 1e6:.1f} Mpixel/s, "
+			  f"anyvnc-cli CPU {100 * cpu / elapsed:.0f}%")
+	finally:
+		stop.set()
+		if changer.is_alive():
+			changer.join()
+		if server:
+			server.terminate()
+			server.wait()
+		xvfb.terminate()
+		xvfb.wait()
+
+
+def main():
+	parser = argparse.ArgumentParser(description="measures the capture frame rate of the X11 framebuffer in Xvfb")
+	parser.add_argument("--cli", default="anyvnc-cli", help="anyvnc-cli executable")
+	parser.add_argument("--display", default=":99", help="display number for Xvfb")
+	parser.add_argument("--duration", type=float, default=10, help="seconds to measure per resolution")
+	parser.add_argument("resolutions", nargs="*", default=["1920x1080", "3840x2160"])
+	arguments = parser.parse_args()
+
+	for resolution in arguments.resolutions:
+		measure(arguments.cli, resolution, arguments.display, arguments.duration)
+
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())